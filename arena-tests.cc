@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include "arena.hh"
+
+/****** Arena Invariants ******/
+
+// Invariant 1
+// Live blocks never overlap, and every block is ARENA_ALIGN aligned.
+
+// Invariant 2
+// A freed small block is handed out again by the next allocation of the same size class.
+
+// Invariant 3
+// An allocation that cannot get a new chunk returns NULL and leaves the arena unchanged.
+
+/****** Begin Tests ******/
+
+// A test of invariant 1: blocks are disjoint and aligned, across chunk boundaries
+TEST(ArenaTest, Invariant1) {
+  arena_t a;
+  arena_init(&a);
+  char *blocks[5000];
+  for(int i=0; i < 5000; i++){
+    blocks[i] = (char*) arena_alloc(&a, 40);
+    ASSERT_EQ(0, (long) blocks[i] % ARENA_ALIGN);
+    memset(blocks[i], i % 128, 40);
+  }
+  char *big = (char*) arena_alloc(&a, ARENA_CHUNK * 2); // Larger than a chunk
+  memset(big, 0xff, ARENA_CHUNK * 2);
+  for(int i=0; i < 5000; i++){ // Nothing was overwritten by a later block
+    for(int j=0; j < 40; j++) ASSERT_EQ(i % 128, blocks[i][j]);
+  }
+  arena_release(&a);
+}
+
+// A test of invariant 2: recycling through the free lists
+TEST(ArenaTest, Invariant2) {
+  arena_t a;
+  arena_init(&a);
+  void *first = arena_alloc(&a, 24);
+  void *second = arena_alloc(&a, 24);
+  arena_free(&a, first, 24);
+  ASSERT_EQ(first, arena_alloc(&a, 20)); // Same class after rounding
+  // The free list is empty again, so the next block is bumped right after second
+  ASSERT_EQ((char*) second + ARENA_ALIGN * 2, arena_alloc(&a, 24));
+  arena_free(&a, second, 24);
+  arena_free(&a, first, 24);
+  ASSERT_EQ(first, arena_alloc(&a, 24)); // Most recently freed first
+  ASSERT_EQ(second, arena_alloc(&a, 24));
+
+  // Release drops every chunk and free list; the arena is empty but usable afterwards
+  arena_free(&a, first, 24);
+  arena_release(&a);
+  ASSERT_EQ(NULL, a.chunks);
+  ASSERT_EQ(NULL, a.free_lists[24 / ARENA_ALIGN]);
+  ASSERT_NE((void*) NULL, arena_alloc(&a, 24));
+  ASSERT_NE((void*) NULL, a.chunks);
+  arena_release(&a);
+}
+
+// A test of invariant 3: a request malloc cannot satisfy, made while a chunk is current
+TEST(ArenaTest, Invariant3) {
+  arena_t a;
+  arena_init(&a);
+  char *first = (char*) arena_alloc(&a, 24);
+  ASSERT_NE((void*) NULL, first);
+  arena_chunk_t *chunks = a.chunks;
+  char *cursor = a.cursor, *limit = a.limit;
+  ASSERT_EQ(NULL, arena_alloc(&a, (size_t) 1 << 62)); // Far more than any machine can give
+  ASSERT_EQ(chunks, a.chunks);
+  ASSERT_EQ(cursor, a.cursor);
+  ASSERT_EQ(limit, a.limit);
+  ASSERT_EQ(first + ARENA_ALIGN * 2, arena_alloc(&a, 24)); // Still usable
+  arena_release(&a);
+}
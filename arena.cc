@@ -0,0 +1,79 @@
+#include "arena.hh"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+// Arena implementation: blocks are carved from ARENA_CHUNK-sized chunks by bumping a cursor,
+// so an allocation is a pointer increment and releasing the arena is one free per chunk no
+// matter how many blocks it held. Freed small blocks go onto a per-size-class free list and
+// are handed out again before the cursor moves; larger freed blocks wait for arena_release.
+
+// Round a size up to its allocation size
+static size_t arena_round(size_t size){
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+// Initialize an empty arena
+void arena_init(arena_t* arena) {
+  arena->chunks = NULL;
+  arena->cursor = NULL;
+  arena->limit = NULL;
+  for(int i=0; i<ARENA_CLASSES; i++){
+    arena->free_lists[i] = NULL;
+  }
+}
+
+// Get a new chunk with at least size usable bytes and make it the current one.
+// Returns false, leaving the arena unchanged, if malloc fails.
+static bool arena_grow(arena_t* arena, size_t size){
+  size_t header = arena_round(sizeof(arena_chunk_t));
+  size_t bytes = size + header > ARENA_CHUNK ? size + header : ARENA_CHUNK;
+  arena_chunk_t *chunk = (arena_chunk_t*) malloc(bytes);
+  if(chunk == NULL){
+    perror("Could not allocate space");
+    return false;
+  }
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+  arena->cursor = (char*) chunk + header;
+  arena->limit = (char*) chunk + bytes;
+  return true;
+}
+
+// Allocate size bytes from an arena
+void* arena_alloc(arena_t* arena, size_t size) {
+  size = arena_round(size);
+  size_t cls = size / ARENA_ALIGN - 1;
+  if(cls < ARENA_CLASSES && arena->free_lists[cls] != NULL){ // Recycle a freed block
+    arena_block_t *block = arena->free_lists[cls];
+    arena->free_lists[cls] = block->next;
+    return block;
+  }
+  if(arena->cursor == NULL || (size_t)(arena->limit - arena->cursor) < size){
+    if(!arena_grow(arena, size)) return NULL;
+  }
+  void *ptr = arena->cursor;
+  arena->cursor += size;
+  return ptr;
+}
+
+// Give a block of size bytes back to an arena for reuse by later allocations
+void arena_free(arena_t* arena, void* ptr, size_t size) {
+  size_t cls = arena_round(size) / ARENA_ALIGN - 1;
+  if(ptr == NULL || cls >= ARENA_CLASSES) return; // Too big to recycle; reclaimed on release
+  arena_block_t *block = (arena_block_t*) ptr;
+  block->next = arena->free_lists[cls];
+  arena->free_lists[cls] = block;
+}
+
+// Free every block in an arena at once. The arena is empty and usable afterwards.
+void arena_release(arena_t* arena) {
+  arena_chunk_t *chunk = arena->chunks;
+  while(chunk != NULL){
+    arena_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  arena_init(arena);
+}
@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK (64 * 1024) // Bytes requested from malloc at a time
+#define ARENA_ALIGN 16          // Every block is aligned to, and sized in multiples of, this
+#define ARENA_CLASSES 16        // Freed blocks up to ARENA_CLASSES * ARENA_ALIGN bytes are recycled
+
+typedef struct arena_chunk {
+  struct arena_chunk *next;
+} arena_chunk_t;
+
+typedef struct arena_block {
+  struct arena_block *next;
+} arena_block_t;
+
+// Bump allocator. Not thread safe: the owner serializes access (e.g. under a bucket lock).
+typedef struct arena {
+  arena_chunk_t *chunks; // Every chunk this arena got from malloc
+  char *cursor, *limit;  // Free space left in the newest chunk
+  arena_block_t *free_lists[ARENA_CLASSES]; // Freed blocks by size class
+} arena_t;
+
+// Initialize an empty arena
+void arena_init(arena_t* arena);
+
+// Allocate size bytes from an arena
+void* arena_alloc(arena_t* arena, size_t size);
+
+// Give a block of size bytes back to an arena for reuse by later allocations
+void arena_free(arena_t* arena, void* ptr, size_t size);
+
+// Free every block in an arena at once. The arena is empty and usable afterwards.
+void arena_release(arena_t* arena);
+
+#endif
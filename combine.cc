@@ -0,0 +1,80 @@
+#include "combine.hh"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+
+// Flat combining (Hendler et al.): instead of every thread taking the lock in turn, threads
+// publish their operation in a slot and whichever thread wins the lock applies every pending
+// slot in one pass. The structure's cache lines then stay on the combiner's core, and the lock
+// changes hands once per batch instead of once per operation.
+
+static int next_slot = 0; // Next preferred slot handed out to a new thread
+static __thread int my_slot = -1; // This thread's preferred slot, assigned on first use
+
+// Allocate an empty combiner
+fc_t* fc_create() {
+  fc_t *fc = (fc_t*) aligned_alloc(CACHE_LINE, sizeof(fc_t));
+  if(fc == NULL) perror("Could not allocate space");
+  for(int i=0; i<FC_SLOTS; i++){
+    fc->slots[i].pending = 0;
+    fc->slots[i].in_use = 0;
+  }
+  return fc;
+}
+
+// Free a combiner. No thread may be using it.
+void fc_destroy(fc_t* fc) {
+  free(fc);
+}
+
+// Claim a publication slot, starting from this thread's preferred one
+static fc_slot_t* fc_claim(fc_t* fc){
+  if(my_slot == -1) my_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) % FC_SLOTS;
+  for(int i = my_slot;; i = (i + 1) % FC_SLOTS){
+    int expected = 0;
+    if(__atomic_load_n(&fc->slots[i].in_use, __ATOMIC_RELAXED) == 0 &&
+       __atomic_compare_exchange_n(&fc->slots[i].in_use, &expected, 1, false,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+      return &fc->slots[i];
+    }
+    cpu_relax();
+  }
+}
+
+// Apply every pending request. The caller must hold the lock.
+static void fc_combine(fc_t* fc, void* structure, fc_apply_t apply){
+  for(int i=0; i<FC_SLOTS; i++){
+    fc_slot_t *slot = &fc->slots[i];
+    if(__atomic_load_n(&slot->pending, __ATOMIC_ACQUIRE)){
+      apply(structure, slot);
+      __atomic_store_n(&slot->pending, 0, __ATOMIC_RELEASE); // Hand the result back
+    }
+  }
+}
+
+// Publish a request and wait until some lock holder (possibly this thread) applies it.
+// On return slot_out holds the applied request's result and node.
+void fc_execute(fc_t* fc, my_lock_t* lock, void* structure, fc_apply_t apply,
+                int op, void* node, fc_slot_t* slot_out) {
+  fc_slot_t *slot = fc_claim(fc);
+  slot->op = op;
+  slot->node = node;
+  __atomic_store_n(&slot->pending, 1, __ATOMIC_RELEASE);
+  SCHED_POINT();
+
+  for(int spins = 0; __atomic_load_n(&slot->pending, __ATOMIC_ACQUIRE); spins++){
+    if(lock_try_acquire(lock)){ // Become the combiner
+      fc_combine(fc, structure, apply);
+      lock_release(lock);
+    } else if(spins < LOCK_SPINS){
+      cpu_relax();
+    } else {
+      sched_yield(); // Let the combiner run if it shares our CPU
+    }
+  }
+
+  slot_out->result = slot->result;
+  slot_out->node = slot->node;
+  __atomic_store_n(&slot->in_use, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,37 @@
+#ifndef COMBINE_H
+#define COMBINE_H
+
+#include <stdbool.h>
+
+#include "lock.hh"
+
+#define FC_SLOTS 64 // Publication slots per combiner; more threads than this share slots
+
+// A request published by one thread for whichever thread holds the lock to apply
+typedef struct fc_slot {
+  int op;      // Structure-specific operation code
+  int result;  // Structure-specific result, written by the combiner
+  void *node;  // Node handed to or returned by the combiner
+  int pending; // Set by the requester, cleared by the combiner once applied
+  int in_use;  // Claimed by a requester for the duration of one operation
+} __attribute__((aligned(CACHE_LINE))) fc_slot_t;
+
+typedef struct fc {
+  fc_slot_t slots[FC_SLOTS];
+} fc_t;
+
+// Apply one published request to a structure. Called with the structure's lock held.
+typedef void (*fc_apply_t)(void* structure, fc_slot_t* slot);
+
+// Allocate an empty combiner
+fc_t* fc_create();
+
+// Free a combiner. No thread may be using it.
+void fc_destroy(fc_t* fc);
+
+// Publish a request and wait until some lock holder (possibly this thread) applies it.
+// On return slot_out holds the applied request's result and node.
+void fc_execute(fc_t* fc, my_lock_t* lock, void* structure, fc_apply_t apply,
+                int op, void* node, fc_slot_t* slot_out);
+
+#endif
@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+
+#include <poll.h>
+
+#include "coqueue.hh"
+
+#define NUM_PRODUCERS 8
+#define NUM_CONSUMERS 4
+#define PUTS_PER_PRODUCER 20000
+
+/****** Coroutine Queue Invariants ******/
+
+// The invariants of my_queue_t hold for elements taken with co_await coqueue_take, plus:
+
+// Invariant 1
+// A coroutine suspended in coqueue_take is resumed, with an element, by the first put that
+// finds it waiting, and takers are served oldest first.
+
+// Invariant 2
+// Once an element has been put and not taken, the event fd polls readable.
+
+/****** Begin Tests ******/
+
+// Fire-and-forget coroutine that runs until its first suspension when called
+struct task {
+  struct promise_type {
+    task get_return_object() { return task(); }
+    std::suspend_never initial_suspend() { return std::suspend_never(); }
+    std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+    void return_void() {}
+    void unhandled_exception() { abort(); }
+  };
+};
+
+// Coroutine for tests: take count elements, storing them in order
+task take_into(my_coqueue_t* q, int* out, int count) {
+  for(int i=0; i < count; i++) {
+    out[i] = co_await coqueue_take(q);
+  }
+}
+
+// Coroutine for tests: put an element through the awaitable interface
+task put_from_coroutine(my_coqueue_t* q, int element) {
+  co_await coqueue_put(q, element);
+}
+
+// A test of invariant 1: suspended takers are resumed in order by puts
+TEST(CoqueueTest, Invariant1) {
+  my_coqueue_t q;
+  coqueue_init(&q, NULL, NULL);
+  int first[3] = {-1, -1, -1}, second[1] = {-1};
+  take_into(&q, first, 3); // Suspends: the queue is empty
+  take_into(&q, second, 1);
+  ASSERT_EQ(-1, first[0]);
+
+  coqueue_put(&q, 10); // Resumes the first taker inline, which suspends again
+  ASSERT_EQ(10, first[0]);
+  ASSERT_EQ(-1, second[0]);
+  put_from_coroutine(&q, 20); // The second taker has waited longest
+  ASSERT_EQ(20, second[0]);
+  coqueue_put(&q, 30);
+  ASSERT_EQ(30, first[1]);
+
+  // A new taker queues behind a suspended one even if an element is already there, as when a
+  // put has queued its element but not yet looked for waiters
+  queue_put(&q.queue, 31);
+  int third[1] = {-1};
+  take_into(&q, third, 1);
+  ASSERT_EQ(-1, third[0]);
+  coqueue_put(&q, 32); // Matches both, oldest taker first
+  ASSERT_EQ(31, first[2]);
+  ASSERT_EQ(32, third[0]);
+
+  // Elements already queued are taken without suspending
+  coqueue_put(&q, 40);
+  coqueue_put(&q, -1); // -1 is an ordinary element here
+  int both[2];
+  take_into(&q, both, 2);
+  ASSERT_EQ(40, both[0]);
+  ASSERT_EQ(-1, both[1]);
+  coqueue_destroy(&q);
+}
+
+// A test of invariant 2: the event fd tracks puts and is reset by draining
+TEST(CoqueueTest, Invariant2) {
+  my_coqueue_t q;
+  coqueue_init(&q, NULL, NULL);
+  struct pollfd pfd = {coqueue_event_fd(&q), POLLIN, 0};
+  ASSERT_EQ(0, poll(&pfd, 1, 0));
+
+  coqueue_put(&q, 1);
+  coqueue_put(&q, 2);
+  ASSERT_EQ(1, poll(&pfd, 1, 0));
+
+  coqueue_clear_event(&q);
+  int element;
+  ASSERT_TRUE(coqueue_try_take(&q, &element));
+  ASSERT_EQ(1, element);
+  ASSERT_TRUE(coqueue_try_take(&q, &element));
+  ASSERT_EQ(2, element);
+  ASSERT_FALSE(coqueue_try_take(&q, &element));
+  ASSERT_EQ(0, poll(&pfd, 1, 0));
+
+  coqueue_put(&q, 3);
+  ASSERT_EQ(1, poll(&pfd, 1, 0));
+  coqueue_destroy(&q);
+}
+
+typedef struct executor {
+  std::coroutine_handle<> ready[4];
+  int count;
+} executor_t;
+
+// Scheduler for tests: queue a woken taker on an executor instead of resuming it
+void schedule_on(std::coroutine_handle<> handle, void* arg) {
+  executor_t *ex = (executor_t*) arg;
+  ex->ready[ex->count++] = handle;
+}
+
+// Woken takers go to the executor, which resumes them when it runs
+TEST(CoqueueTest, Executor) {
+  executor_t ex;
+  ex.count = 0;
+  my_coqueue_t q;
+  coqueue_init(&q, schedule_on, &ex);
+  int out[1] = {-1};
+  take_into(&q, out, 1);
+  coqueue_put(&q, 5);
+  ASSERT_EQ(-1, out[0]); // Not resumed by the put
+  ASSERT_EQ(1, ex.count);
+  ex.ready[0].resume();
+  ASSERT_EQ(5, out[0]);
+  coqueue_destroy(&q);
+}
+
+typedef struct consumer {
+  my_coqueue_t *q;
+  int last[NUM_PRODUCERS]; // Last sequence number seen from each producer
+  long taken;
+  bool in_order;
+  bool done;
+} consumer_t;
+
+// Coroutine for the concurrent test: take until a -1, checking per-producer order (invariant 3)
+task consume(consumer_t* c) {
+  for(;;) {
+    int element = co_await coqueue_take(c->q);
+    if(element == -1) break;
+    int producer = element / PUTS_PER_PRODUCER, seq = element % PUTS_PER_PRODUCER;
+    if(seq <= c->last[producer]) c->in_order = false;
+    c->last[producer] = seq;
+    c->taken++;
+  }
+  __atomic_store_n(&c->done, true, __ATOMIC_RELEASE);
+}
+
+typedef struct producer_args {
+  my_coqueue_t *q;
+  int id;
+} producer_args_t;
+
+// Worker thread for tests: put this producer's elements in sequence
+void* put_worker(void* arg) {
+  producer_args_t *args = (producer_args_t*) arg;
+  for(int i=0; i < PUTS_PER_PRODUCER; i++) {
+    coqueue_put(args->q, args->id * PUTS_PER_PRODUCER + i);
+  }
+  pthread_exit(0);
+}
+
+// Consumer coroutines resumed by producer threads see every element once, in producer order
+TEST(CoqueueTest, ConcurrentPutTake) {
+  my_coqueue_t q;
+  coqueue_init(&q, NULL, NULL);
+  consumer_t consumers[NUM_CONSUMERS];
+  for(int i=0; i < NUM_CONSUMERS; i++) {
+    consumers[i].q = &q;
+    for(int p=0; p < NUM_PRODUCERS; p++) consumers[i].last[p] = -1;
+    consumers[i].taken = 0;
+    consumers[i].in_order = true;
+    consumers[i].done = false;
+    consume(&consumers[i]);
+  }
+
+  pthread_t workers[NUM_PRODUCERS];
+  producer_args_t args[NUM_PRODUCERS];
+  for(int i=0; i < NUM_PRODUCERS; i++) {
+    args[i].q = &q;
+    args[i].id = i;
+    if(pthread_create(&workers[i], NULL, put_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_PRODUCERS; i++) {
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+  for(int i=0; i < NUM_CONSUMERS; i++) {
+    coqueue_put(&q, -1); // One stop element per consumer
+  }
+
+  long taken = 0;
+  for(int i=0; i < NUM_CONSUMERS; i++) {
+    ASSERT_TRUE(__atomic_load_n(&consumers[i].done, __ATOMIC_ACQUIRE));
+    ASSERT_TRUE(consumers[i].in_order);
+    taken += consumers[i].taken;
+  }
+  ASSERT_EQ(NUM_PRODUCERS * PUTS_PER_PRODUCER, taken);
+  coqueue_destroy(&q);
+}
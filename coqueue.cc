@@ -0,0 +1,141 @@
+#include "coqueue.hh"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Coroutine queue implementation: a my_queue_t plus a FIFO list of suspended takers. A taker
+// that finds the queue empty registers itself, counts itself in waiting, and then looks at the
+// queue once more before suspending. A putter puts first and then reads waiting. Both sides
+// use sequentially consistent operations between the two steps, so either the taker sees the
+// element or the putter sees the taker. Whoever sees both pairs waiters with elements under
+// the waiter lock, so elements still leave the queue in FIFO order.
+// The event fd is written only when signaled goes from clear to set, so a burst of puts
+// costs one write() until a consumer clears it.
+
+// Initialize a coroutine queue. Woken takers are passed to schedule with schedule_arg, or
+// resumed on the putting thread if schedule is NULL.
+void coqueue_init(my_coqueue_t* queue, coqueue_schedule_t schedule, void* schedule_arg) {
+  queue_init(&queue->queue);
+  lock_init(&queue->lock);
+  queue->first = queue->last = NULL;
+  queue->waiting = 0;
+  queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(queue->event_fd == -1) perror("Could not create eventfd");
+  queue->signaled = 0;
+  queue->schedule = schedule;
+  queue->schedule_arg = schedule_arg;
+}
+
+// Destroy a coroutine queue. No coroutine may be suspended on it.
+void coqueue_destroy(my_coqueue_t* queue) {
+  queue_destroy(&queue->queue);
+  lock_destroy(&queue->lock);
+  if(queue->event_fd != -1) close(queue->event_fd);
+}
+
+// coqueue_match hands queued elements to waiters, oldest first, until one side runs out.
+// Returns the matched waiters as a list to resume. The caller must hold the waiter lock.
+static coqueue_waiter_t* coqueue_match(my_coqueue_t* queue){
+  coqueue_waiter_t *matched = NULL, **end = &matched;
+  while(queue->first != NULL && queue_poll(&queue->queue, &queue->first->value)){
+    coqueue_waiter_t *waiter = queue->first;
+    queue->first = waiter->next;
+    if(queue->first == NULL) queue->last = NULL;
+    __atomic_sub_fetch(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+    waiter->next = NULL;
+    *end = waiter;
+    end = &waiter->next;
+  }
+  return matched;
+}
+
+// coqueue_resume resumes every matched waiter except skip, after the waiter lock is released
+static void coqueue_resume(my_coqueue_t* queue, coqueue_waiter_t* matched, coqueue_waiter_t* skip){
+  while(matched != NULL){
+    coqueue_waiter_t *next = matched->next; // The waiter lives in a frame that may end on resume
+    if(matched != skip){
+      if(queue->schedule != NULL) queue->schedule(matched->handle, queue->schedule_arg);
+      else matched->handle.resume();
+    }
+    matched = next;
+  }
+}
+
+// Put an element at the end of a coroutine queue, waking the oldest suspended taker if there is
+// one. Never blocks; the result may be co_awaited from a coroutine.
+coqueue_put_op_t coqueue_put(my_coqueue_t* queue, int element) {
+  queue_put(&queue->queue, element);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&queue->waiting, __ATOMIC_SEQ_CST) > 0){
+    lock_acquire(&queue->lock);
+    coqueue_waiter_t *matched = coqueue_match(queue);
+    lock_release(&queue->lock);
+    coqueue_resume(queue, matched, NULL);
+  }
+  if(queue->event_fd != -1 && __atomic_exchange_n(&queue->signaled, 1, __ATOMIC_SEQ_CST) == 0){
+    uint64_t one = 1;
+    if(write(queue->event_fd, &one, sizeof(one)) != sizeof(one)) perror("Could not signal eventfd");
+  }
+  return coqueue_put_op_t();
+}
+
+// Take an element off the front of a coroutine queue: co_await coqueue_take(queue) suspends the
+// calling coroutine, without blocking its thread, until an element is available.
+coqueue_take_op_t coqueue_take(my_coqueue_t* queue) {
+  coqueue_take_op_t op;
+  op.queue = queue;
+  op.waiter.next = NULL;
+  return op;
+}
+
+// Take without suspending if an element is already there and no older taker is waiting for
+// it; otherwise queue up behind the suspended takers in await_suspend
+bool coqueue_take_op::await_ready() {
+  if(__atomic_load_n(&queue->waiting, __ATOMIC_SEQ_CST) > 0) return false;
+  return queue_poll(&queue->queue, &waiter.value);
+}
+
+// Register as a waiter, then check the queue again: a put that finished before this taker was
+// counted in waiting would not have looked for it. Returns false if this taker got an element.
+bool coqueue_take_op::await_suspend(std::coroutine_handle<> handle) {
+  my_coqueue_t *queue = this->queue; // Once the lock is released, another thread may resume us
+  waiter.handle = handle;
+  waiter.next = NULL;
+  lock_acquire(&queue->lock);
+  if(queue->last != NULL) queue->last->next = &waiter;
+  else queue->first = &waiter;
+  queue->last = &waiter;
+  __atomic_add_fetch(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+  coqueue_waiter_t *matched = coqueue_match(queue);
+  bool served = false;
+  for(coqueue_waiter_t *w = matched; w != NULL; w = w->next){
+    if(w == &waiter) served = true;
+  }
+  lock_release(&queue->lock);
+  coqueue_resume(queue, matched, &waiter);
+  return !served;
+}
+
+// Take an element off the front of a coroutine queue without waiting. This does not queue
+// behind suspended takers, so it is meant for event fd consumers that never co_await.
+// Returns true and stores the element if one was taken, false if the queue is empty.
+bool coqueue_try_take(my_coqueue_t* queue, int* element) {
+  return queue_poll(&queue->queue, element);
+}
+
+// Get an eventfd for poll/epoll that is readable while elements may be waiting. After it
+// polls readable, call coqueue_clear_event and then take with coqueue_try_take until empty.
+int coqueue_event_fd(my_coqueue_t* queue) {
+  return queue->event_fd;
+}
+
+// Reset the event fd before draining the queue, so later puts make it readable again
+void coqueue_clear_event(my_coqueue_t* queue) {
+  uint64_t count;
+  if(read(queue->event_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) perror("Could not read eventfd");
+  __atomic_store_n(&queue->signaled, 0, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,75 @@
+#ifndef COQUEUE_H
+#define COQUEUE_H
+
+// Needs C++20 for <coroutine>
+
+#include <stdbool.h>
+#include <coroutine>
+
+#include "queue.hh"
+#include "lock.hh"
+
+// Hands a resumable coroutine to an executor instead of resuming it on the calling thread
+typedef void (*coqueue_schedule_t)(std::coroutine_handle<> handle, void* arg);
+
+typedef struct coqueue_waiter {
+  struct coqueue_waiter *next;
+  std::coroutine_handle<> handle;
+  int value; // Element handed over by the thread that wakes this waiter
+} coqueue_waiter_t;
+
+typedef struct my_coqueue {
+  my_queue_t queue;
+  my_lock_t lock; // Guards the waiter list
+  coqueue_waiter_t *first, *last; // Suspended takers, oldest first
+  int waiting; // Number of suspended takers, read by putters without the lock
+  int event_fd; // eventfd that is readable while elements may be waiting
+  int signaled; // Set once event_fd has been written and not yet cleared
+  coqueue_schedule_t schedule; // NULL to resume takers on the putting thread
+  void *schedule_arg;
+} my_coqueue_t;
+
+// Awaitable returned by coqueue_take
+typedef struct coqueue_take_op {
+  my_coqueue_t *queue;
+  coqueue_waiter_t waiter;
+  bool await_ready();
+  bool await_suspend(std::coroutine_handle<> handle);
+  int await_resume() { return waiter.value; }
+} coqueue_take_op_t;
+
+// Awaitable returned by coqueue_put. The put has already happened, so it never suspends.
+typedef struct coqueue_put_op {
+  bool await_ready() { return true; }
+  void await_suspend(std::coroutine_handle<>) {}
+  void await_resume() {}
+} coqueue_put_op_t;
+
+// Initialize a coroutine queue. Woken takers are passed to schedule with schedule_arg, or
+// resumed on the putting thread if schedule is NULL.
+void coqueue_init(my_coqueue_t* queue, coqueue_schedule_t schedule, void* schedule_arg);
+
+// Destroy a coroutine queue. No coroutine may be suspended on it.
+void coqueue_destroy(my_coqueue_t* queue);
+
+// Put an element at the end of a coroutine queue, waking the oldest suspended taker if there is
+// one. Never blocks; the result may be co_awaited from a coroutine.
+coqueue_put_op_t coqueue_put(my_coqueue_t* queue, int element);
+
+// Take an element off the front of a coroutine queue: co_await coqueue_take(queue) suspends the
+// calling coroutine, without blocking its thread, until an element is available.
+coqueue_take_op_t coqueue_take(my_coqueue_t* queue);
+
+// Take an element off the front of a coroutine queue without waiting. This does not queue
+// behind suspended takers, so it is meant for event fd consumers that never co_await.
+// Returns true and stores the element if one was taken, false if the queue is empty.
+bool coqueue_try_take(my_coqueue_t* queue, int* element);
+
+// Get an eventfd for poll/epoll that is readable while elements may be waiting. After it
+// polls readable, call coqueue_clear_event and then take with coqueue_try_take until empty.
+int coqueue_event_fd(my_coqueue_t* queue);
+
+// Reset the event fd before draining the queue, so later puts make it readable again
+void coqueue_clear_event(my_coqueue_t* queue);
+
+#endif
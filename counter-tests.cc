@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include "counter.hh"
+
+#define NUM_THREADS 16
+#define ADDS_PER_THREAD 10000
+
+/****** Counter Invariants ******/
+
+// Invariant 1
+// Once all writers have finished, counter_read returns the sum of every delta passed to counter_add.
+
+// Invariant 2
+// counter_read_approx never differs from counter_read by more than counter_error_bound(), which
+// is COUNTER_BATCH per shard in use.
+
+/****** Begin Tests ******/
+
+// Worker thread for tests: add one ADDS_PER_THREAD times
+void* add_worker(void* arg){
+  my_counter_t *c = (my_counter_t*) arg;
+  for(int i=0; i < ADDS_PER_THREAD; i++){
+    counter_add(c, 1);
+  }
+  pthread_exit(0);
+}
+
+// A test of invariant 1: no concurrent update is lost
+TEST(CounterTest, Invariant1){
+  my_counter_t c;
+  counter_init(&c);
+
+  pthread_t workers[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++){
+    if(pthread_create(&workers[i], NULL, add_worker, &c) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++){ // Wait for threads to exit
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  ASSERT_EQ(NUM_THREADS * ADDS_PER_THREAD, counter_read(&c));
+}
+
+// A test of invariant 2: approximate reads stay within the error bound
+TEST(CounterTest, Invariant2){
+  my_counter_t c;
+  counter_init(&c);
+
+  pthread_t workers[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++){
+    if(pthread_create(&workers[i], NULL, add_worker, &c) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++){ // Wait for threads to exit
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  ASSERT_LE(labs(counter_read(&c) - counter_read_approx(&c)), counter_error_bound());
+  ASSERT_LE(counter_error_bound(), COUNTER_SHARDS * COUNTER_BATCH);
+}
+
+// Basic counter functionality
+TEST(CounterTest, BasicCounterOps){
+  my_counter_t c;
+  counter_init(&c);
+  ASSERT_EQ(0, counter_read(&c));
+
+  // Add and subtract some values
+  counter_add(&c, 5);
+  counter_add(&c, -2);
+  ASSERT_EQ(3, counter_read(&c));
+
+  // Cross the flush threshold in both directions
+  counter_add(&c, COUNTER_BATCH * 3);
+  ASSERT_EQ(3 + COUNTER_BATCH * 3, counter_read(&c));
+  counter_add(&c, -COUNTER_BATCH * 3 - 3);
+  ASSERT_EQ(0, counter_read(&c));
+  ASSERT_EQ(0, counter_read_approx(&c));
+}
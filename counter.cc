@@ -0,0 +1,66 @@
+#include "counter.hh"
+
+#include <stdlib.h>
+
+// Counter implementation: each thread adds into its own shard, and a shard is only folded
+// into the shared global count once its delta reaches COUNTER_BATCH. The global count's
+// cache line is therefore touched once every COUNTER_BATCH updates instead of on every one.
+
+static int next_slot = 0; // Next shard handed out to a new thread
+static __thread int my_slot = -1; // This thread's shard, assigned on first use
+
+// Get the shard index for the calling thread
+static int counter_slot(){
+  if(my_slot == -1){
+    // Release, so a reader that sees the new next_slot also looks at this thread's shard
+    my_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELEASE) % COUNTER_SHARDS;
+  }
+  return my_slot;
+}
+
+// Initialize a counter to zero
+void counter_init(my_counter_t* counter) {
+  counter->global = 0;
+  for(int i=0; i<COUNTER_SHARDS; i++){
+    counter->shards[i].delta = 0;
+  }
+}
+
+// Add delta (which may be negative) to a counter
+void counter_add(my_counter_t* counter, long delta) {
+  counter_shard_t *shard = &counter->shards[counter_slot()];
+  // Shards are shared once there are more than COUNTER_SHARDS threads, so updates stay atomic
+  long local = __atomic_add_fetch(&shard->delta, delta, __ATOMIC_RELAXED);
+  if(labs(local) >= COUNTER_BATCH){
+    // Move the whole shard delta into the global count. Exchange makes sure no update is lost.
+    local = __atomic_exchange_n(&shard->delta, 0, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->global, local, __ATOMIC_RELAXED);
+  }
+}
+
+// Get the number of shards handed out to threads so far. Shards past it have never been written.
+static int counter_shards_used(){
+  int used = __atomic_load_n(&next_slot, __ATOMIC_ACQUIRE);
+  return used < COUNTER_SHARDS ? used : COUNTER_SHARDS;
+}
+
+// Read a counter approximately: O(1), off by at most counter_error_bound()
+long counter_read_approx(my_counter_t* counter) {
+  return __atomic_load_n(&counter->global, __ATOMIC_RELAXED);
+}
+
+// Read a counter exactly by summing every shard in use. Exact once writers are quiescent.
+long counter_read(my_counter_t* counter) {
+  long sum = __atomic_load_n(&counter->global, __ATOMIC_ACQUIRE);
+  int used = counter_shards_used();
+  for(int i=0; i<used; i++){
+    sum += __atomic_load_n(&counter->shards[i].delta, __ATOMIC_ACQUIRE);
+  }
+  return sum;
+}
+
+// Get how far counter_read_approx can be from the exact count: COUNTER_BATCH for each shard
+// handed out so far, so at most COUNTER_SHARDS * COUNTER_BATCH
+long counter_error_bound() {
+  return (long) counter_shards_used() * COUNTER_BATCH;
+}
@@ -0,0 +1,37 @@
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <stdbool.h>
+
+#include "lock.hh"
+
+#define COUNTER_SHARDS 64 // Number of per-thread shards
+#define COUNTER_BATCH 32  // Shard delta that triggers a flush into the global count
+
+// One shard per cache line so threads never share a line when counting
+typedef struct counter_shard {
+  long delta;
+} __attribute__((aligned(CACHE_LINE))) counter_shard_t;
+
+typedef struct my_counter {
+  long global __attribute__((aligned(CACHE_LINE))); // Flushed total, read by approximate reads
+  counter_shard_t shards[COUNTER_SHARDS];
+} my_counter_t;
+
+// Initialize a counter to zero
+void counter_init(my_counter_t* counter);
+
+// Add delta (which may be negative) to a counter
+void counter_add(my_counter_t* counter, long delta);
+
+// Read a counter approximately: O(1), off by at most counter_error_bound()
+long counter_read_approx(my_counter_t* counter);
+
+// Read a counter exactly by summing every shard in use. Exact once writers are quiescent.
+long counter_read(my_counter_t* counter);
+
+// Get how far counter_read_approx can be from the exact count: COUNTER_BATCH for each shard
+// handed out so far, so at most COUNTER_SHARDS * COUNTER_BATCH
+long counter_error_bound();
+
+#endif
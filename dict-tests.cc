@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <unistd.h>
+
 #include "dict.hh"
+#include "lincheck.hh"
 
 #define NUM_THREADS 25
 
@@ -19,6 +22,10 @@
 // Invariant 4
 // If a key has been removed, dict_get should return -1
 
+// Invariant 5
+// Every history of concurrent operations is linearizable: each operation appears to take effect at one instant
+// between its call and its return, in an order a sequential map would accept.
+
 /****** Synchronization ******/
 
 // Under what circumstances can accesses to your dictionary structure can proceed in parallel? Answer below.
@@ -112,6 +119,7 @@ TEST(DictionaryTest, Invariant4) {
   for(int i=0; i < NUM_THREADS; i++) {
     ASSERT_EQ(dict_get(&d, (const char*) words[i]), -1); // No values in dict
   }
+  ASSERT_EQ(0, dict_size(&d));
   // Clean up
   dict_destroy(&d);
 }
@@ -229,6 +237,8 @@ TEST(DictionaryTest, Invariant1) {
   for(int i=0; i < NUM_THREADS; i++) {
     ASSERT_TRUE(dict_contains(&d, words[i]));
   }
+  ASSERT_EQ(NUM_THREADS, dict_size(&d));
+  ASSERT_DOUBLE_EQ((double) NUM_THREADS / BUCKETS, dict_load_factor(&d));
   // Clean up
   dict_destroy(&d);
 }
@@ -292,3 +302,605 @@ TEST(DictionaryTest, BasicDictionaryOps) {
   // Clean up
   dict_destroy(&d);
 }
+
+// Non-blocking set/get
+TEST(DictionaryTest, TryDictionaryOps) {
+  my_dict_t d;
+  dict_init(&d);
+  int val = 0;
+
+  // Uncontended operations always run
+  ASSERT_TRUE(dict_try_get(&d, "A", &val));
+  ASSERT_EQ(-1, val);
+  ASSERT_TRUE(dict_try_set(&d, "A", 1));
+  ASSERT_TRUE(dict_try_get(&d, "A", &val));
+  ASSERT_EQ(1, val);
+  ASSERT_TRUE(dict_try_set(&d, "A", 2));
+  ASSERT_EQ(1, dict_size(&d));
+
+  // A held bucket lock makes both fail fast (a single-character key hashes to its ASCII value)
+  list_t *bucket = d.lists['A' % BUCKETS];
+  lock_acquire(&bucket->lock);
+  ASSERT_FALSE(dict_try_set(&d, "A", 3));
+  ASSERT_FALSE(dict_try_get(&d, "A", &val));
+  lock_release(&bucket->lock);
+
+  ASSERT_EQ(2, dict_get(&d, "A"));
+
+  // Clean up
+  dict_destroy(&d);
+}
+
+#define TTL_MS 200      // Long enough that a stalled test still reads a key before it expires
+#define TTL_WAIT_MS 600 // Sleep that is sure to outlast TTL_MS
+
+// Entries set with a TTL disappear once it runs out
+TEST(DictionaryTest, TTLExpiry) {
+  my_dict_t d;
+  dict_init(&d);
+
+  dict_set_ttl(&d, "short", 1, TTL_MS);
+  dict_set_ttl(&d, "long", 2, 60000);
+  dict_set(&d, "forever", 3);
+  ASSERT_EQ(1, dict_get(&d, "short"));
+  ASSERT_EQ(3, dict_size(&d));
+
+  usleep(TTL_WAIT_MS * 1000); // Let the short TTL run out
+
+  // Expired keys behave as removed (invariants 1 and 4)
+  ASSERT_FALSE(dict_contains(&d, "short"));
+  ASSERT_EQ(-1, dict_get(&d, "short"));
+  ASSERT_EQ(2, dict_get(&d, "long"));
+  ASSERT_EQ(3, dict_get(&d, "forever"));
+  ASSERT_EQ(2, dict_size(&d));
+
+  // Resetting a key with dict_set clears its TTL
+  dict_set_ttl(&d, "again", 4, TTL_MS);
+  dict_set(&d, "again", 5);
+  usleep(TTL_WAIT_MS * 1000);
+  ASSERT_EQ(0, dict_expire(&d));
+  ASSERT_EQ(5, dict_get(&d, "again"));
+
+  dict_stats_t stats;
+  dict_get_stats(&d, &stats);
+  ASSERT_EQ(1, stats.expirations);
+  ASSERT_EQ(1, stats.misses);
+  ASSERT_EQ(4, stats.hits);
+
+  // Clean up
+  dict_destroy(&d);
+}
+
+// A capped dictionary evicts instead of growing, and CLOCK spares recently read keys
+TEST(DictionaryTest, CacheEviction) {
+  my_dict_t d;
+  dict_init_cache(&d, NUM_THREADS);
+  char words[NUM_THREADS * 4][4];
+
+  for(int i=0; i < NUM_THREADS * 4; i++) {
+    words[i][0] = 'a' + i % 26;
+    words[i][1] = 'a' + i / 26;
+    words[i][2] = 'k';
+    words[i][3] = '\0';
+    dict_set(&d, words[i], i);
+    dict_get(&d, words[0]); // Keep one key hot
+    ASSERT_LE(dict_size(&d), NUM_THREADS);
+  }
+  ASSERT_EQ(NUM_THREADS, dict_size(&d));
+  ASSERT_EQ(0, dict_get(&d, words[0]));
+
+  dict_stats_t stats;
+  dict_get_stats(&d, &stats);
+  ASSERT_EQ(NUM_THREADS * 3, stats.evictions);
+
+  // Clean up
+  dict_destroy(&d);
+}
+
+#define SMALL_CAP 10
+#define CAP_SETS_PER_THREAD 2000
+
+// Worker thread for tests: set CAP_SETS_PER_THREAD keys no other worker sets
+void* cap_worker(void* arg){
+  set_args_t *args = (set_args_t*) arg;
+  char key[32];
+  for(int i=0; i < CAP_SETS_PER_THREAD; i++){
+    snprintf(key, sizeof(key), "%d-%d", args->val, i);
+    dict_set(args->d, key, i);
+  }
+  pthread_exit(0);
+}
+
+// A cache much smaller than the counter's error bound holds its cap under concurrent inserts
+TEST(DictionaryTest, SmallCacheEviction) {
+  my_dict_t d;
+  dict_init_cache(&d, SMALL_CAP);
+  pthread_t workers[NUM_THREADS];
+  set_args_t args[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++) {
+    args[i].d = &d;
+    args[i].val = i;
+    if(pthread_create(&workers[i], NULL, cap_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++) {
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  // Every insert past the cap evicted one entry; racing inserts can each see the cap unmet
+  long size = dict_size(&d);
+  ASSERT_GE(size, 1);
+  ASSERT_LE(size, SMALL_CAP + NUM_THREADS);
+  dict_stats_t stats;
+  dict_get_stats(&d, &stats);
+  ASSERT_EQ(NUM_THREADS * CAP_SETS_PER_THREAD, size + stats.evictions);
+
+  // Clean up
+  dict_destroy(&d);
+}
+
+#define BULK_PAIRS 20000
+
+// Bulk loading matches the equivalent sequence of dict_set calls
+TEST(DictionaryTest, BulkLoad) {
+  my_dict_t d;
+  dict_init(&d);
+  dict_set(&d, "existing", 1);
+  dict_set(&d, "k7", -7); // Overwritten by the load
+
+  static char keys[BULK_PAIRS][8];
+  static dict_pair_t pairs[BULK_PAIRS + 1];
+  for(int i=0; i < BULK_PAIRS; i++){
+    snprintf(keys[i], sizeof(keys[i]), "k%d", i);
+    pairs[i].key = keys[i];
+    pairs[i].val = i;
+  }
+  pairs[BULK_PAIRS].key = keys[3]; // A later duplicate wins
+  pairs[BULK_PAIRS].val = 333;
+  dict_bulk_load(&d, pairs, BULK_PAIRS + 1, 4);
+
+  ASSERT_EQ(BULK_PAIRS + 1, dict_size(&d));
+  ASSERT_EQ(1, dict_get(&d, "existing"));
+  ASSERT_EQ(7, dict_get(&d, "k7"));
+  ASSERT_EQ(333, dict_get(&d, "k3"));
+  for(int i=0; i < BULK_PAIRS; i++){
+    if(i != 3){
+      ASSERT_EQ(i, dict_get(&d, keys[i]));
+    }
+  }
+
+  // Clean up
+  dict_destroy(&d);
+}
+
+// Bulk loading from a "key value" file
+TEST(DictionaryTest, BulkLoadFile) {
+  char path[] = "/tmp/dict-tests-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  FILE *file = fdopen(fd, "w");
+  fprintf(file, "alpha 1\nbeta 2\nmalformed\ngamma -3\ndelta x\nepsilon 5z\nzeta 99999999999\nalpha 10\n");
+  fclose(file);
+
+  my_dict_t d;
+  dict_init(&d);
+  ASSERT_EQ(4, dict_bulk_load_file(&d, path, 0));
+  ASSERT_EQ(3, dict_size(&d));
+  ASSERT_EQ(10, dict_get(&d, "alpha"));
+  ASSERT_EQ(2, dict_get(&d, "beta"));
+  ASSERT_EQ(-3, dict_get(&d, "gamma"));
+  ASSERT_FALSE(dict_contains(&d, "delta")); // Values that are not whole ints are skipped
+  ASSERT_FALSE(dict_contains(&d, "epsilon"));
+  ASSERT_FALSE(dict_contains(&d, "zeta"));
+  ASSERT_EQ(-1, dict_bulk_load_file(&d, "/nonexistent/path", 0));
+
+  // A pipe cannot seek, so it must be streamed
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  const char *piped = "a 1\nb 2";
+  ASSERT_EQ((ssize_t) strlen(piped), write(fds[1], piped, strlen(piped)));
+  close(fds[1]);
+  char pipe_path[32];
+  snprintf(pipe_path, sizeof(pipe_path), "/dev/fd/%d", fds[0]);
+  ASSERT_EQ(2, dict_bulk_load_file(&d, pipe_path, 0));
+  close(fds[0]);
+  ASSERT_EQ(1, dict_get(&d, "a"));
+  ASSERT_EQ(2, dict_get(&d, "b"));
+
+  // Clean up
+  unlink(path);
+  dict_destroy(&d);
+}
+
+// Arena mode: the invariants hold, removal recycles space, and clear keeps the dictionary usable
+TEST(DictionaryTest, ArenaDictionaryOps) {
+  my_dict_t d;
+  dict_init_arena(&d);
+  char words[NUM_THREADS][3];
+
+  // Concurrent sets as in the invariant tests
+  pthread_t workers[NUM_THREADS];
+  set_args_t args[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++) {
+    words[i][0] = 'a';
+    words[i][1] = 'a' + i;
+    words[i][2] = '\0';
+    args[i].d = &d;
+    args[i].key = words[i];
+    args[i].val = i;
+    if(pthread_create(&workers[i], NULL, set_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++) {
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++) {
+    ASSERT_EQ(i, dict_get(&d, words[i]));
+  }
+
+  // A removed node's space is reused by the next same-sized key in its bucket
+  list_t *bucket = d.lists[('a' + 'a') % BUCKETS]; // words[0] sums to 'a' + 'a'
+  node_t *old = bucket->head;
+  char key[3];
+  strcpy(key, old->key);
+  dict_remove(&d, key);
+  dict_set(&d, key, 99);
+  ASSERT_EQ(old, bucket->head);
+  ASSERT_EQ(99, dict_get(&d, key));
+
+  // Buckets count their entries, so clearing can drop whole arenas without walking them
+  long entries = 0;
+  for(int i=0; i < BUCKETS; i++) entries += d.lists[i]->entries;
+  ASSERT_EQ(dict_size(&d), entries);
+
+  // Clearing empties the dictionary but keeps it usable
+  dict_clear(&d);
+  ASSERT_EQ(0, dict_size(&d));
+  ASSERT_EQ(0, bucket->entries);
+  ASSERT_EQ(NULL, bucket->arena->chunks);
+  for(int i=0; i < NUM_THREADS; i++) {
+    ASSERT_FALSE(dict_contains(&d, words[i]));
+  }
+  dict_set(&d, "A", 1);
+  ASSERT_EQ(1, dict_get(&d, "A"));
+
+  // Clean up
+  dict_destroy(&d);
+}
+
+// With a membership filter the invariants still hold, and most misses skip the bucket locks
+TEST(DictionaryTest, FilteredLookups) {
+  my_dict_t d;
+  dict_init(&d);
+  dict_set(&d, "before", 1); // Present before the filter is attached
+  dict_enable_filter(&d, 1000);
+  char words[NUM_THREADS][3];
+
+  // Concurrent sets as in the invariant tests
+  pthread_t workers[NUM_THREADS];
+  set_args_t args[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++) {
+    words[i][0] = 'f';
+    words[i][1] = 'a' + i;
+    words[i][2] = '\0';
+    args[i].d = &d;
+    args[i].key = words[i];
+    args[i].val = i;
+    if(pthread_create(&workers[i], NULL, set_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++) {
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  // No false negatives
+  ASSERT_EQ(1, dict_get(&d, "before"));
+  for(int i=0; i < NUM_THREADS; i++) {
+    ASSERT_EQ(i, dict_get(&d, words[i]));
+  }
+
+  // Removed keys leave the filter, so invariants 1 and 4 are answered without locks
+  dict_remove(&d, words[0]);
+  ASSERT_FALSE(dict_contains(&d, words[0]));
+  ASSERT_EQ(-1, dict_get(&d, words[0]));
+
+  // Lookups of absent keys are mostly filtered
+  char absent[8];
+  for(int i=0; i < 1000; i++) {
+    snprintf(absent, sizeof(absent), "x%d", i);
+    ASSERT_EQ(-1, dict_get(&d, absent));
+  }
+  dict_stats_t stats;
+  dict_get_stats(&d, &stats);
+  ASSERT_GE(stats.filtered, 950);
+
+  // Removes of absent keys skip the bucket too, but are not lookups
+  for(int i=0; i < 1000; i++) {
+    snprintf(absent, sizeof(absent), "x%d", i);
+    dict_remove(&d, absent);
+  }
+  long filtered = stats.filtered;
+  dict_get_stats(&d, &stats);
+  ASSERT_EQ(filtered, stats.filtered);
+
+  // Clearing empties the filter too
+  dict_clear(&d);
+  ASSERT_FALSE(dict_contains(&d, "before"));
+  dict_set(&d, "before", 2);
+  ASSERT_EQ(2, dict_get(&d, "before"));
+
+  // Clean up
+  dict_destroy(&d);
+}
+
+#define HOT_READS 100000
+
+// Reader thread for the read cache test: reads a hot key, whose value only ever increases
+void* hot_reader(void* p) {
+  my_dict_t *d = (my_dict_t*) p;
+  int last = 0;
+  for(int i=0; i < HOT_READS; i++) {
+    int val = dict_get(d, "hot");
+    if(val < last) return (void*) 1; // A stale cached value
+    last = val;
+  }
+  return NULL;
+}
+
+// With read caches the invariants still hold, and repeated reads of a key are served locally
+TEST(DictionaryTest, ReadCache) {
+  my_dict_t d;
+  dict_init(&d);
+  dict_enable_read_cache(&d);
+
+  // Invariant 2: the second read comes from the cache
+  dict_set(&d, "A", 1);
+  ASSERT_EQ(1, dict_get(&d, "A"));
+  ASSERT_EQ(1, dict_get(&d, "A"));
+  dict_stats_t stats;
+  dict_get_stats(&d, &stats);
+  ASSERT_EQ(1, stats.cached);
+  ASSERT_EQ(2, stats.hits);
+
+  // Invariants 3 and 4: writes invalidate cached values
+  dict_set(&d, "A", 2);
+  ASSERT_EQ(2, dict_get(&d, "A"));
+  dict_remove(&d, "A");
+  ASSERT_EQ(-1, dict_get(&d, "A"));
+  ASSERT_FALSE(dict_contains(&d, "A"));
+
+  // A cached value still expires with its TTL
+  dict_set_ttl(&d, "B", 3, TTL_MS);
+  ASSERT_EQ(3, dict_get(&d, "B"));
+  ASSERT_EQ(3, dict_get(&d, "B"));
+  usleep(TTL_WAIT_MS * 1000);
+  ASSERT_EQ(-1, dict_get(&d, "B"));
+
+  // Invariant 3 under concurrency: readers never see a value older than one they already read
+  pthread_t readers[NUM_THREADS];
+  dict_set(&d, "hot", 1);
+  for(int i=0; i < NUM_THREADS; i++) {
+    if(pthread_create(&readers[i], NULL, hot_reader, &d) != 0) perror("Could not create thread");
+  }
+  for(int i=2; i <= 1000; i++) {
+    dict_set(&d, "hot", i);
+  }
+  for(int i=0; i < NUM_THREADS; i++) {
+    void *stale;
+    if(pthread_join(readers[i], &stale) != 0) perror("Could not exit thread");
+    ASSERT_EQ(NULL, stale);
+  }
+  ASSERT_EQ(1000, dict_get(&d, "hot"));
+  dict_get_stats(&d, &stats);
+  ASSERT_GT(stats.cached, 0);
+
+  // A new dictionary never sees the old one's cache entries
+  dict_destroy(&d);
+  dict_init(&d);
+  dict_enable_read_cache(&d);
+  ASSERT_EQ(-1, dict_get(&d, "hot"));
+
+  // Clean up
+  dict_destroy(&d);
+}
+
+#define FEED_KEYS 200
+#define FEED_ROUNDS 50
+
+// Subscriber callback for the change feed test: replay a record onto a standby dictionary
+void apply_to_standby(const feed_record_t* record, void* arg) {
+  my_dict_t *standby = (my_dict_t*) arg;
+  if(record->op == FEED_SET) dict_set_ttl(standby, record->key, record->val, record->ttl_ms);
+  else dict_remove(standby, record->key);
+}
+
+// Worker thread for the change feed test: churn through this thread's share of the keys
+void* churn_worker(void* arg) {
+  set_args_t *args = (set_args_t*) arg;
+  char key[16];
+  for(int round=0; round < FEED_ROUNDS; round++) {
+    for(int i=args->val; i < FEED_KEYS; i += NUM_THREADS) {
+      snprintf(key, sizeof(key), "%s%d", args->key, i);
+      if((round + i) % 3 == 0) dict_remove(args->d, key);
+      else dict_set(args->d, key, round * FEED_KEYS + i);
+    }
+  }
+  pthread_exit(0);
+}
+
+// A standby fed from the change feed ends up holding exactly what the primary holds
+TEST(DictionaryTest, ChangeFeed) {
+  my_dict_t primary, standby;
+  dict_init(&primary);
+  dict_init(&standby);
+  dict_set(&primary, "before", 1); // Present before the feed is attached
+  my_feed_t feed;
+  ASSERT_TRUE(feed_init(&feed, BUCKETS, NULL));
+  dict_attach_feed(&primary, &feed);
+  feed_subscribe(&feed, apply_to_standby, &standby);
+
+  pthread_t workers[NUM_THREADS];
+  set_args_t args[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++) {
+    args[i].d = &primary;
+    args[i].key = "c";
+    args[i].val = i;
+    if(pthread_create(&workers[i], NULL, churn_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++) {
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+  dict_remove(&primary, "c0");
+  dict_clear(&primary); // Shows up as removals
+  dict_set(&primary, "after", 2);
+  feed_unsubscribe(&feed);
+
+  ASSERT_EQ(1, dict_size(&standby));
+  ASSERT_EQ(-1, dict_get(&standby, "before"));
+  ASSERT_EQ(2, dict_get(&standby, "after"));
+
+  // Without the clear, both sides hold the same keys and values
+  feed_subscribe(&feed, apply_to_standby, &standby);
+  for(int i=0; i < NUM_THREADS; i++) {
+    if(pthread_create(&workers[i], NULL, churn_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++) {
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+  feed_unsubscribe(&feed);
+  char key[16];
+  for(int i=0; i < FEED_KEYS; i++) {
+    snprintf(key, sizeof(key), "c%d", i);
+    ASSERT_EQ(dict_get(&primary, key), dict_get(&standby, key));
+  }
+  ASSERT_EQ(dict_size(&primary), dict_size(&standby));
+
+  // Clean up
+  dict_destroy(&primary);
+  dict_destroy(&standby);
+  feed_destroy(&feed);
+}
+
+#define REBUILDS 20
+
+static my_dict_t *live_dict; // Dictionary the churn workers currently use
+static int stop_churn;
+
+// Worker thread for the rebuild test: set, read and remove on whichever dictionary is live
+void* rebuild_worker(void* arg) {
+  long id = (long) arg, bad = 0;
+  char key[16];
+  for(int i=0; !__atomic_load_n(&stop_churn, __ATOMIC_ACQUIRE); i++) {
+    my_dict_t *d = __atomic_load_n(&live_dict, __ATOMIC_ACQUIRE);
+    snprintf(key, sizeof(key), "r%ld-%d", id, i % 50);
+    dict_set(d, key, i % 50);
+    int val = dict_get(d, key);
+    if(val != i % 50 && val != -1) bad++; // Own key: the value just set, or -1 once destroyed
+    if(i % 2 == 0) dict_remove(d, key);
+  }
+  return (void*) bad;
+}
+
+// Dictionaries can be destroyed and replaced while other threads are still using them
+TEST(DictionaryTest, OnlineRebuild) {
+  my_dict_t dicts[REBUILDS + 1];
+  dict_init(&dicts[0]);
+  live_dict = &dicts[0];
+  stop_churn = 0;
+
+  pthread_t workers[NUM_THREADS];
+  for(long i=0; i < NUM_THREADS; i++) {
+    if(pthread_create(&workers[i], NULL, rebuild_worker, (void*) i) != 0) perror("Could not create thread");
+  }
+  for(int r=1; r <= REBUILDS; r++) {
+    if(r % 3 == 0) dict_init_arena(&dicts[r]); // Alternate the configurations
+    else dict_init(&dicts[r]);
+    if(r % 3 == 1) dict_enable_read_cache(&dicts[r]);
+    if(r % 2 == 0) dict_enable_filter(&dicts[r], 1000);
+    __atomic_store_n(&live_dict, &dicts[r], __ATOMIC_RELEASE);
+    usleep(1000);
+    dict_destroy(&dicts[r - 1]); // Threads may still be inside it
+    ASSERT_EQ(-1, dict_get(&dicts[r - 1], "r0-0"));
+    ASSERT_FALSE(dict_contains(&dicts[r - 1], "r0-0"));
+    ASSERT_EQ(0, dict_size(&dicts[r - 1]));
+    ASSERT_EQ(0, dict_load_factor(&dicts[r - 1]));
+    dict_stats_t stats;
+    dict_get_stats(&dicts[r - 1], &stats);
+    ASSERT_EQ(0, stats.hits + stats.misses);
+  }
+  __atomic_store_n(&stop_churn, 1, __ATOMIC_RELEASE);
+  for(int i=0; i < NUM_THREADS; i++) {
+    void *bad;
+    if(pthread_join(workers[i], &bad) != 0) perror("Could not exit thread");
+    ASSERT_EQ(NULL, bad);
+  }
+
+  // Clean up
+  dict_destroy(&dicts[REBUILDS]);
+}
+
+static const char* lincheck_keys[LINCHECK_KEYS] = {"k0", "k1", "k2", "k3", "k4", "k5", "k6", "k7"};
+
+// Round for the linearizability test: a random mix of every operation on a few keys
+void lincheck_dict_round(my_history_t* history, void* target, int thread, int first, int ops){
+  my_dict_t *d = (my_dict_t*) target;
+  for(int i=0; i < ops; i++){
+    unsigned int r = history_random(history, thread);
+    int key = (r >> 4) % LINCHECK_KEYS, result = -1;
+    bool ok = true;
+    lincheck_op_t *op;
+    switch(r % 10){
+    case 0: case 1: case 2:
+      op = history_invoke(history, thread, LINCHECK_SET, key, first + i);
+      dict_set(d, lincheck_keys[key], first + i);
+      break;
+    case 3:
+      op = history_invoke(history, thread, LINCHECK_SET, key, first + i);
+      ok = dict_try_set(d, lincheck_keys[key], first + i);
+      break;
+    case 4: case 5: case 6:
+      op = history_invoke(history, thread, LINCHECK_GET, key, 0);
+      result = dict_get(d, lincheck_keys[key]);
+      break;
+    case 7:
+      op = history_invoke(history, thread, LINCHECK_GET, key, 0);
+      ok = dict_try_get(d, lincheck_keys[key], &result);
+      break;
+    case 8:
+      op = history_invoke(history, thread, LINCHECK_REMOVE, key, 0);
+      dict_remove(d, lincheck_keys[key]);
+      break;
+    default:
+      op = history_invoke(history, thread, LINCHECK_CONTAINS, key, 0);
+      result = dict_contains(d, lincheck_keys[key]);
+      break;
+    }
+    history_respond(history, op, ok ? result : -1, ok);
+  }
+}
+
+// Drain for the linearizability test: read every key, then clear the dictionary
+void lincheck_dict_drain(my_history_t* history, void* target, int thread, int first, int ops){
+  my_dict_t *d = (my_dict_t*) target;
+  for(int key=0; key < LINCHECK_KEYS; key++){
+    lincheck_op_t *op = history_invoke(history, thread, LINCHECK_GET, key, 0);
+    int result = dict_get(d, lincheck_keys[key]);
+    history_respond(history, op, result, true);
+  }
+  dict_clear(d);
+}
+
+// A test of invariant 5 in every mode that never drops keys on its own, with operations
+// delayed at random
+TEST(DictionaryTest, Linearizable) {
+  lincheck_state_t empty;
+  empty.length = LINCHECK_KEYS;
+  for(int i=0; i < LINCHECK_KEYS; i++) empty.items[i] = -1;
+  my_dict_t d;
+  for(int mode=0; mode < 4; mode++){
+    if(mode == 1) dict_init_arena(&d);
+    else dict_init(&d);
+    if(mode == 2) dict_enable_filter(&d, LINCHECK_KEYS);
+    if(mode == 3) dict_enable_read_cache(&d);
+    ASSERT_EQ(0, lincheck_run(&d, lincheck_dict_round, lincheck_dict_drain, lincheck_dict_step, &empty,
+                              LINCHECK_THREADS, LINCHECK_OPS, LINCHECK_ROUNDS, LINCHECK_PERTURB, mode + 1));
+    dict_destroy(&d);
+  }
+}
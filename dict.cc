@@ -3,110 +3,380 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <assert.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
-#define BUCKETS 20
+#include "epoch.hh"
 
 // Dictionary implementation: Array of BUCKETS buckets, each holds a doubly-linked list of key-value pairs.
+// Entries may carry an expiry time, and a dictionary initialized with dict_init_cache holds at
+// most max_entries keys. Expired entries are reaped whenever a lookup, a set or the eviction
+// hand runs into them, and all at once by dict_expire. Eviction is CLOCK: dict_get sets a
+// node's referenced bit under the bucket lock it already holds, and an insert over the cap
+// walks buckets from a shared hand, giving referenced nodes a second chance and evicting the
+// first one that was not touched since the last pass.
+// With dict_enable_read_cache, every thread keeps a small direct-mapped cache of the values it
+// has read. Each bucket has a write version that every change to the bucket bumps while holding
+// its lock; a cached value is only used while its bucket's version is unchanged, so a cache hit
+// costs one read of a line that only writers modify. Cache hits do not set the CLOCK bit.
+// With dict_attach_feed, every change is also appended to the bucket's shard of a change feed
+// while the bucket lock is held, so each key's records are in the order its changes happened.
+// Every operation runs inside an epoch critical section, so dict_destroy can close the
+// dictionary and wait for operations already running to finish before freeing the buckets;
+// operations that arrive after that see an empty dictionary.
 // List implementation:
 
-// list_set sets key-value pair, adding one if none exists for that key.
-void list_set(list_t* list, const char* key, int val){
-  pthread_mutex_lock(&(list->lock));
+// Milliseconds on a monotonic clock, for TTLs
+static long now_ms(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// FNV-1a, for spreading keys over tables other than the buckets
+static unsigned long fnv_hash(const char* key){
+  unsigned long h = 14695981039346656037UL;
+  for(; *key != '\0'; key++){
+    h ^= (unsigned char) *key;
+    h *= 1099511628211UL;
+  }
+  return h;
+}
+
+// node_expired returns true if a node's TTL has run out
+static bool node_expired(node_t* node, long now){
+  return node->expires != 0 && node->expires <= now;
+}
+
+// node_new allocates a node for a key/value pair and links it in at the head of the list.
+// In arena mode the node and its key come from the list's arena as one block. The key is added
+// to the membership filter before the node becomes reachable, so the filter never misses it.
+// The caller must hold the list lock.
+static node_t* node_new(my_dict_t* dict, list_t* list, const char* key, int val, long expires){
+  if(dict->filter != NULL) filter_add(dict->filter, key);
+  size_t length = strlen(key) + 1;
+  node_t *node;
+  if(list->arena != NULL){
+    node = (node_t*) arena_alloc(list->arena, sizeof(node_t) + length);
+    assert(node != NULL);
+    node->key = (char*) (node + 1); // Key bytes follow the node
+  } else {
+    node = (node_t*) malloc(sizeof(node_t));
+    assert(node != NULL);
+    node->key = (char*) malloc(length);
+    assert(node->key != NULL);
+  }
+  memcpy(node->key, key, length);
+  node->val = val;
+  node->expires = expires;
+  node->referenced = 1;
+  node->parent = NULL;
+  node->child = list->head;
+  if(list->head != NULL) list->head->parent = node;
+  list->head = node;
+  list->entries++;
+  return node;
+}
+
+// node_delete frees a node, returning it to the list's arena in arena mode
+static void node_delete(list_t* list, node_t* node){
+  list->entries--;
+  if(list->arena != NULL){
+    arena_free(list->arena, node, sizeof(node_t) + strlen(node->key) + 1);
+  } else {
+    free(node->key);
+    free(node);
+  }
+}
+
+// list_changed bumps the list's write version, invalidating every read cache entry for the
+// list. The caller must hold the list lock.
+static void list_changed(list_t* list){
+  if(list->version == NULL) return;
+  // Sequentially consistent, so a read that starts after the change returns can't miss it
+  __atomic_store_n(&list->version->value, list->version->value + 1, __ATOMIC_SEQ_CST);
+}
+
+// node_feed_key returns a key for the feed record of a node that is about to be freed. A malloc
+// node hands over its own key, so nothing is allocated under the list lock; an arena node's key
+// lives in the arena and has to be copied. The caller must hold the list lock.
+static char* node_feed_key(list_t* list, node_t* node){
+  if(list->arena != NULL) return feed_key(node->key);
+  char *key = node->key;
+  node->key = NULL;
+  return key;
+}
+
+// list_unlink unlinks a node from the list and frees it. The key leaves the membership filter
+// only after the node is unreachable. If the list has a feed, the removal is appended with
+// key_copy, a feed_key copy made before the lock was taken, or NULL to take the node's key.
+// The caller must hold the list lock.
+static void list_unlink(my_dict_t* dict, list_t* list, node_t* node, char* key_copy){
+  if(node == list->head) list->head = node->child;
+  if(node->parent != NULL) node->parent->child = node->child;
+  if(node->child != NULL) node->child->parent = node->parent;
+  if(dict->filter != NULL) filter_remove(dict->filter, node->key);
+  if(list->feed != NULL){
+    feed_append(list->feed, FEED_REMOVE, key_copy != NULL ? key_copy : node_feed_key(list, node), 0, 0);
+  }
+  node_delete(list, node);
+  list_changed(list);
+}
+
+// list_find returns the live node holding the given key, or NULL if there is none. If the key's
+// node has expired, it is reaped on the way. The caller must hold the list lock.
+static node_t* list_find(my_dict_t* dict, list_t* list, const char* key){
   for(node_t *current = list->head; current != NULL; current = current->child){
-    // Case where we find key/val pair
     if(strcmp(current->key, key) == 0){
-      current->val = val;
-      pthread_mutex_unlock(&(list->lock));
-      return;
-      // Case where we reach end of list
-    } else if(current->child == NULL){ // End of list, allocate new node for key/val pair
-      current->child = (node_t*) malloc(sizeof(node_t));
-      assert(current->child != NULL);
-      current->child->val = val;
-      current->child->key = (char*) malloc(strlen(key) + 1);
-      assert(current->child->key != NULL);
-      strncpy(current->child->key, key, strlen(key) + 1);
-      current->child->parent = current;
-      current->child->child = NULL;
-      pthread_mutex_unlock(&(list->lock));
-      return;
+      if(current->expires != 0 && node_expired(current, now_ms())){
+        list_unlink(dict, list, current, NULL);
+        counter_add(&dict->count, -1);
+        counter_add(&dict->expirations, 1);
+        return NULL;
+      }
+      return current;
     }
   }
-  // Case where list is empty
-  list->head = (node_t*) malloc(sizeof(node_t));
-  assert(list->head != NULL);
-  list->head->val = val;
+  return NULL;
+}
 
-  list->head->key = (char*) malloc(strlen(key) + 1);
-  assert(list->head->key != NULL);
-  strncpy(list->head->key, key, strlen(key) + 1);
+// list_set_locked sets key-value pair, adding one at the head if none exists for that key.
+// ttl_ms of 0 means the pair never expires. If the list has a feed, key_copy is a feed_key copy
+// of key for its record. The caller must hold the list lock.
+// Returns true if a new pair was added.
+static bool list_set_locked(my_dict_t* dict, list_t* list, const char* key, int val, long ttl_ms, char* key_copy){
+  long expires = ttl_ms > 0 ? now_ms() + ttl_ms : 0;
+  node_t *current = list_find(dict, list, key);
+  // Case where we find key/val pair
+  if(current != NULL){
+    current->val = val;
+    current->expires = expires;
+    current->referenced = 1;
+    list_changed(list);
+    if(list->feed != NULL) feed_append(list->feed, FEED_SET, key_copy, val, ttl_ms);
+    return false;
+  }
+  // Case where key is absent: allocate new node for key/val pair
+  node_new(dict, list, key, val, expires);
+  if(list->feed != NULL) feed_append(list->feed, FEED_SET, key_copy, val, ttl_ms);
+  counter_add(&dict->count, 1);
+  list_changed(list);
+  return true;
+}
 
-  list->head->parent = NULL;
-  list->head->child = NULL;
-  pthread_mutex_unlock(&(list->lock));
+// list_set sets key-value pair, adding one if none exists for that key.
+// Returns true if a new pair was added.
+bool list_set(my_dict_t* dict, list_t* list, const char* key, int val, long ttl_ms){
+  char *key_copy = list->feed != NULL ? feed_key(key) : NULL; // Allocate before locking
+  lock_acquire(&(list->lock));
+  bool added = list_set_locked(dict, list, key, val, ttl_ms, key_copy);
+  lock_release(&(list->lock));
+  return added;
+}
+
+// list_try_set is list_set, unless another thread holds the list lock.
+// Returns true if the pair was set; *added records whether it was new.
+bool list_try_set(my_dict_t* dict, list_t* list, const char* key, int val, bool* added){
+  char *key_copy = list->feed != NULL ? feed_key(key) : NULL; // Allocate before locking
+  if(!lock_try_acquire(&(list->lock))){
+    free(key_copy);
+    return false;
+  }
+  *added = list_set_locked(dict, list, key, val, 0, key_copy);
+  lock_release(&(list->lock));
+  return true;
 }
 
 // list_contains returns true if a given key has an entry in the list.
-bool list_contains(list_t* list, const char* key){
-  pthread_mutex_lock(&(list->lock));
-  node_t *current = list->head;
-  while(current != NULL){
-    if(strcmp(current->key, key) == 0){
-      pthread_mutex_unlock(&(list->lock));
-      return true; // return true if key is found
-    }
-    current = current->child;
+bool list_contains(my_dict_t* dict, list_t* list, const char* key){
+  lock_acquire(&(list->lock));
+  bool found = list_find(dict, list, key) != NULL;
+  lock_release(&(list->lock));
+  return found;
+}
+
+// Read caches: one per thread, direct-mapped by key hash. An entry belongs to the dictionary
+// whose cache_id it carries, so entries left over from a destroyed dictionary never match.
+
+typedef struct dict_cache_entry {
+  unsigned long cache_id; // Owning dictionary, 0 for an empty entry
+  unsigned long version;  // Bucket version the value was read at
+  long expires;
+  int val;
+  char key[DICT_CACHE_KEY];
+} dict_cache_entry_t;
+
+static __thread dict_cache_entry_t read_cache[DICT_CACHE_SLOTS];
+static unsigned long next_cache_id = 1;
+
+// dict_cache_entry returns the calling thread's read cache entry for key
+static dict_cache_entry_t* dict_cache_entry(const char* key){
+  return &read_cache[fnv_hash(key) % DICT_CACHE_SLOTS];
+}
+
+// list_cache_fill records a node's value in the calling thread's read cache. The caller must
+// hold the list lock, so the value and the version it is read at belong together.
+static void list_cache_fill(my_dict_t* dict, list_t* list, node_t* node){
+  if(strlen(node->key) >= DICT_CACHE_KEY) return; // Long keys are not cached
+  dict_cache_entry_t *entry = dict_cache_entry(node->key);
+  entry->cache_id = dict->cache_id;
+  entry->version = list->version->value;
+  entry->expires = node->expires;
+  entry->val = node->val;
+  strcpy(entry->key, node->key);
+}
+
+// list_cache_get stores the value for key in *val if the calling thread's read cache holds it
+// and the list has not changed since. Returns true on a cache hit.
+static bool list_cache_get(my_dict_t* dict, list_t* list, const char* key, int* val){
+  dict_cache_entry_t *entry = dict_cache_entry(key);
+  if(entry->cache_id != dict->cache_id) return false;
+  if(entry->version != __atomic_load_n(&list->version->value, __ATOMIC_SEQ_CST)) return false;
+  SCHED_POINT();
+  if(strcmp(entry->key, key) != 0) return false;
+  if(entry->expires != 0 && entry->expires <= now_ms()) return false; // Let the lookup reap it
+  *val = entry->val;
+  counter_add(&dict->hits, 1);
+  counter_add(&dict->cached, 1);
+  return true;
+}
+
+// list_lookup stores the value for a given key in *val (-1 if that key does not exist), marks
+// the node referenced for CLOCK, and counts the hit or miss. The caller must hold the list lock.
+static void list_lookup(my_dict_t* dict, list_t* list, const char* key, int* val){
+  node_t *current = list_find(dict, list, key);
+  if(current != NULL){
+    if(!current->referenced) current->referenced = 1; // Avoid dirtying the line when already set
+    *val = current->val;
+    counter_add(&dict->hits, 1);
+    if(list->version != NULL) list_cache_fill(dict, list, current);
+  } else {
+    *val = -1;
+    counter_add(&dict->misses, 1);
   }
-  pthread_mutex_unlock(&(list->lock));
-  return false;
 }
 
 // list_get returns the value associated with a given key, or -1 if that key does not exist.
-int list_get(list_t* list, const char* key){
-  pthread_mutex_lock(&(list->lock));
-  node_t *current = list->head;
-  while(current != NULL){
-    if(strcmp(current->key, key) == 0){
-      pthread_mutex_unlock(&(list->lock));
-      return current->val; // return true if key is found
+int list_get(my_dict_t* dict, list_t* list, const char* key){
+  int val;
+  lock_acquire(&(list->lock));
+  list_lookup(dict, list, key, &val);
+  lock_release(&(list->lock));
+  return val;
+}
+
+// list_try_get stores the value associated with a given key in *val (-1 if that key does not
+// exist), unless another thread holds the list lock. Returns true if the lookup ran.
+bool list_try_get(my_dict_t* dict, list_t* list, const char* key, int* val){
+  if(!lock_try_acquire(&(list->lock))) return false;
+  list_lookup(dict, list, key, val);
+  lock_release(&(list->lock));
+  return true;
+}
+
+// list_remove removes the given key's key/value pair from the list. If none exists, it does nothing.
+// Returns true if a pair was removed.
+bool list_remove(my_dict_t* dict, list_t* list, const char* key){
+  char *key_copy = list->feed != NULL ? feed_key(key) : NULL; // Allocate before locking
+  lock_acquire(&(list->lock));
+  node_t *current = list_find(dict, list, key);
+  if(current != NULL){ // If key is found, remove node
+    list_unlink(dict, list, current, key_copy);
+    counter_add(&dict->count, -1);
+  }
+  lock_release(&(list->lock));
+  if(current == NULL) free(key_copy);
+  return current != NULL;
+}
+
+// list_sweep reaps every expired node in the list. Returns the number of nodes removed.
+static int list_sweep(my_dict_t* dict, list_t* list){
+  lock_acquire(&(list->lock));
+  long now = now_ms();
+  int removed = 0;
+  for(node_t *current = list->head; current != NULL;){
+    node_t *next = current->child; // Saved before current may be freed
+    if(node_expired(current, now)){
+      list_unlink(dict, list, current, NULL);
+      counter_add(&dict->count, -1);
+      counter_add(&dict->expirations, 1);
+      removed++;
     }
-    current = current->child;
+    current = next;
   }
-  pthread_mutex_unlock(&(list->lock));
-  return -1;
+  lock_release(&(list->lock));
+  return removed;
 }
 
-// list_remove removes the given key's key/value pair from the list. If none exists, it does nothing.
-void list_remove(list_t* list, const char* key){
-  pthread_mutex_lock(&(list->lock));
+// list_clock runs one CLOCK step over the list: referenced nodes lose their bit until the first
+// node that is unreferenced or expired, which is removed and ends the walk.
+// Returns true if a node was removed.
+static bool list_clock(my_dict_t* dict, list_t* list){
+  lock_acquire(&(list->lock));
+  long now = now_ms();
   node_t *current = list->head;
-  while(current != NULL){
-    if(strcmp(current->key, key) == 0){ // If key is found, remove node
-      if(current == list->head) list->head = current->child;
-      if(current->parent != NULL) current->parent->child = current->child;
-      if(current->child != NULL) current->child->parent = current->parent;
-      free(current->key);
-      free(current);
-    }
+  while(current != NULL && current->referenced && !node_expired(current, now)){
+    current->referenced = 0; // Second chance
     current = current->child;
   }
-  pthread_mutex_unlock(&(list->lock));
+  if(current != NULL){
+    counter_add(node_expired(current, now) ? &dict->expirations : &dict->evictions, 1);
+    list_unlink(dict, list, current, NULL);
+    counter_add(&dict->count, -1);
+  }
+  lock_release(&(list->lock));
+  return current != NULL;
 }
 
-// list_destroy destroys the contents of a list and then the list itself
-void list_destroy(list_t* list){
-  pthread_mutex_lock(&(list->lock));
+// list_clear frees every node in the list. Returns the number of nodes freed. An arena list
+// with no filter or feed to tell about each key is dropped without visiting its nodes.
+// The caller must hold the list lock.
+static long list_clear(my_dict_t* dict, list_t* list){
+  long freed = list->entries;
   node_t *current = list->head;
   node_t *next;
+  list->head = NULL; // Unreachable before the filter forgets any key
+  list->entries = 0;
+  list_changed(list);
+  if(list->arena != NULL && dict->filter == NULL && list->feed == NULL){
+    arena_release(list->arena);
+    return freed;
+  }
   while(current != NULL){
     next = current->child;
-    free(current->key);
-    free(current);
+    if(dict->filter != NULL) filter_remove(dict->filter, current->key);
+    if(list->feed != NULL) feed_append(list->feed, FEED_REMOVE, node_feed_key(list, current), 0, 0);
+    if(list->arena == NULL){ // Arena nodes go all at once below
+      free(current->key);
+      free(current);
+    }
     current = next;
   }
-  pthread_mutex_unlock(&(list->lock));
+  if(list->arena != NULL) arena_release(list->arena);
+  return freed;
+}
+
+// list_destroy destroys the contents of a list and then the list itself. The filter and the
+// bucket versions are about to be freed, so unlike list_clear this tells neither about the keys.
+void list_destroy(list_t* list){
+  lock_acquire(&(list->lock));
+  list->feed = NULL; // Destroying is not a mutation the feed should carry
+  if(list->arena != NULL){
+    arena_release(list->arena); // No need to visit the nodes
+    free(list->arena);
+  } else {
+    for(node_t *current = list->head; current != NULL;){
+      node_t *next = current->child;
+      free(current->key);
+      free(current);
+      current = next;
+    }
+  }
+  lock_release(&(list->lock));
   free(list);
 }
 
@@ -131,34 +401,477 @@ void dict_init(my_dict_t* dict) {
     dict->lists[i] = (list_t*) malloc(sizeof(list_t)); // Initialize each array bucket
     assert(dict->lists[i] != NULL);
     dict->lists[i]->head = NULL;
-    if(pthread_mutex_init(&dict->lists[i]->lock, NULL) != 0) perror("Could not initialize mutex lock");
+    dict->lists[i]->arena = NULL;
+    dict->lists[i]->entries = 0;
+    dict->lists[i]->version = NULL;
+    dict->lists[i]->feed = NULL;
+    lock_init(&dict->lists[i]->lock);
+  }
+  counter_init(&dict->count);
+  counter_init(&dict->hits);
+  counter_init(&dict->misses);
+  counter_init(&dict->evictions);
+  counter_init(&dict->expirations);
+  counter_init(&dict->filtered);
+  counter_init(&dict->cached);
+  dict->max_entries = 0;
+  dict->clock_hand = 0;
+  dict->filter = NULL;
+  dict->versions = NULL;
+  dict->cache_id = 0;
+  dict->closed = 0;
+}
+
+// Initialize a dictionary that holds at most max_entries keys, evicting with CLOCK when full
+void dict_init_cache(my_dict_t* dict, long max_entries) {
+  dict_init(dict);
+  dict->max_entries = max_entries;
+}
+
+// Initialize a dictionary whose nodes and keys are allocated from one arena per bucket
+void dict_init_arena(my_dict_t* dict) {
+  dict_init(dict);
+  for(int i=0; i<BUCKETS; i++){
+    dict->lists[i]->arena = (arena_t*) malloc(sizeof(arena_t));
+    assert(dict->lists[i]->arena != NULL);
+    arena_init(dict->lists[i]->arena);
+  }
+}
+
+// Attach a counting Bloom filter sized for expected_keys keys, so lookups of absent keys can
+// return without taking a bucket lock. No other thread may use the dictionary during the call.
+void dict_enable_filter(my_dict_t* dict, long expected_keys) {
+  if(dict->filter != NULL) return;
+  filter_t *filter = (filter_t*) malloc(sizeof(filter_t));
+  assert(filter != NULL);
+  filter_init(filter, expected_keys);
+  for(int i=0; i<BUCKETS; i++){ // Record the keys already present
+    for(node_t *current = dict->lists[i]->head; current != NULL; current = current->child){
+      filter_add(filter, current->key);
+    }
+  }
+  dict->filter = filter;
+}
+
+// Give every thread a small read cache in front of dict_get and dict_try_get, so repeated reads
+// of hot keys skip the bucket lock. Entries are validated against a per-bucket version that
+// every write bumps. No other thread may use the dictionary during the call.
+void dict_enable_read_cache(my_dict_t* dict) {
+  if(dict->versions != NULL) return;
+  dict->versions = (dict_version_t*) aligned_alloc(CACHE_LINE, sizeof(dict_version_t) * BUCKETS);
+  assert(dict->versions != NULL);
+  for(int i=0; i<BUCKETS; i++){
+    dict->versions[i].value = 0;
+    dict->lists[i]->version = &dict->versions[i];
+  }
+  dict->cache_id = __atomic_fetch_add(&next_cache_id, 1, __ATOMIC_RELAXED);
+}
+
+// Send every later mutation of a dictionary to a change feed with BUCKETS shards, one per
+// bucket, starting with a FEED_SET for every key already present. Expiry, eviction and
+// dict_clear show up as FEED_REMOVE records. No other thread may use the dictionary during the
+// call, and the feed must outlive the dictionary.
+void dict_attach_feed(my_dict_t* dict, my_feed_t* feed) {
+  assert(feed->nshards == BUCKETS);
+  long now = now_ms();
+  for(int i=0; i<BUCKETS; i++){
+    list_t *list = dict->lists[i];
+    for(node_t *current = list->head; current != NULL; current = current->child){
+      if(node_expired(current, now)) continue;
+      long ttl_ms = current->expires != 0 ? current->expires - now : 0;
+      feed_append(&feed->shards[i], FEED_SET, feed_key(current->key), current->val, ttl_ms);
+    }
+    list->feed = &feed->shards[i];
   }
 }
 
+// dict_absent returns true if the membership filter proves key is absent
+static bool dict_absent(my_dict_t* dict, const char* key){
+  return dict->filter != NULL && !filter_maybe_contains(dict->filter, key);
+}
+
+// dict_filtered is dict_absent for lookups, counting each one the filter answers
+static bool dict_filtered(my_dict_t* dict, const char* key){
+  if(!dict_absent(dict, key)) return false;
+  counter_add(&dict->filtered, 1);
+  return true;
+}
+
+// Remove every key from a dictionary, keeping it usable
+void dict_clear(my_dict_t* dict) {
+  if(!epoch_enter_open(&dict->closed)) return;
+  for(int i=0; i<BUCKETS; i++){
+    list_t *list = dict->lists[i];
+    lock_acquire(&(list->lock));
+    long freed = list_clear(dict, list);
+    lock_release(&(list->lock));
+    counter_add(&dict->count, -freed);
+  }
+  epoch_exit();
+}
+
 // Destroy a dictionary
 void dict_destroy(my_dict_t* dict) {
+  epoch_close(&dict->closed);
   for(int i=0; i<BUCKETS; i++){
     list_destroy(dict->lists[i]);
   }
   free(dict->lists);
+  if(dict->filter != NULL){
+    filter_destroy(dict->filter);
+    free(dict->filter);
+    dict->filter = NULL;
+  }
+  free(dict->versions);
+  dict->versions = NULL;
+}
+
+// Check whether a dictionary holds more than max_entries keys. The approximate count settles it
+// unless it is within its error bound of the cap. The bound and the exact read both scale with
+// the shards in use, so a small cache used by a few threads touches a few lines, not all
+// COUNTER_SHARDS.
+static bool dict_over_cap(my_dict_t* dict){
+  if(dict->max_entries <= 0) return false;
+  long approx = counter_read_approx(&dict->count);
+  long bound = counter_error_bound();
+  if(approx + bound <= dict->max_entries) return false;
+  if(approx - bound > dict->max_entries) return true;
+  return counter_read(&dict->count) > dict->max_entries;
+}
+
+// Evict one entry, for an insert that found the dictionary over its cap. Each step advances the
+// shared CLOCK hand by one bucket and stops at that bucket's first victim; one pass over every
+// bucket clears all referenced bits, so a second pass must find one unless the dictionary is
+// empty, which bounds the work one insert can be asked to do.
+static void dict_evict(my_dict_t* dict){
+  for(int step=0; step < 2 * BUCKETS; step++){
+    unsigned int bucket = __atomic_fetch_add(&dict->clock_hand, 1, __ATOMIC_RELAXED) % BUCKETS;
+    if(list_clock(dict, dict->lists[bucket])) return;
+  }
 }
 
 // Set a value in a dictionary
 void dict_set(my_dict_t* dict, const char* key, int value) {
-  list_set(dict->lists[hash(key)], key, value);
+  if(!epoch_enter_open(&dict->closed)) return;
+  if(list_set(dict, dict->lists[hash(key)], key, value, 0) && dict_over_cap(dict)) dict_evict(dict);
+  epoch_exit();
+}
+
+// Set a value in a dictionary that expires after ttl_ms milliseconds
+void dict_set_ttl(my_dict_t* dict, const char* key, int value, long ttl_ms) {
+  if(!epoch_enter_open(&dict->closed)) return;
+  if(list_set(dict, dict->lists[hash(key)], key, value, ttl_ms) && dict_over_cap(dict)) dict_evict(dict);
+  epoch_exit();
+}
+
+// Set a value in a dictionary unless another thread holds that key's bucket.
+// Returns true if the value was set.
+bool dict_try_set(my_dict_t* dict, const char* key, int value) {
+  if(!epoch_enter_open(&dict->closed)) return false;
+  bool added = false;
+  bool set = list_try_set(dict, dict->lists[hash(key)], key, value, &added);
+  if(added && dict_over_cap(dict)) dict_evict(dict);
+  epoch_exit();
+  return set;
 }
 
 // Check if a dictionary contains a key
 bool dict_contains(my_dict_t* dict, const char* key) {
-  return list_contains(dict->lists[hash(key)], key);
+  if(!epoch_enter_open(&dict->closed)) return false;
+  bool found = !dict_filtered(dict, key) && list_contains(dict, dict->lists[hash(key)], key);
+  epoch_exit();
+  return found;
 }
 
 // Get a value in a dictionary
 int dict_get(my_dict_t* dict, const char* key) {
-  return list_get(dict->lists[hash(key)], key);
+  if(!epoch_enter_open(&dict->closed)) return -1;
+  list_t *list = dict->lists[hash(key)];
+  int val;
+  bool cached = list->version != NULL && list_cache_get(dict, list, key, &val);
+  if(!cached && dict_filtered(dict, key)){
+    counter_add(&dict->misses, 1);
+    val = -1;
+  } else if(!cached){
+    val = list_get(dict, list, key);
+  }
+  epoch_exit();
+  return val;
+}
+
+// Get a value in a dictionary unless another thread holds that key's bucket.
+// Returns true and stores the value (-1 if absent) if the lookup ran.
+bool dict_try_get(my_dict_t* dict, const char* key, int* value) {
+  if(!epoch_enter_open(&dict->closed)){
+    *value = -1;
+    return true;
+  }
+  list_t *list = dict->lists[hash(key)];
+  bool ran = true;
+  bool cached = list->version != NULL && list_cache_get(dict, list, key, value);
+  if(!cached && dict_filtered(dict, key)){
+    counter_add(&dict->misses, 1);
+    *value = -1;
+  } else if(!cached){
+    ran = list_try_get(dict, list, key, value);
+  }
+  epoch_exit();
+  return ran;
 }
 
 // Remove a value from a dictionary
 void dict_remove(my_dict_t* dict, const char* key) {
-  list_remove(dict->lists[hash(key)], key);
+  if(!epoch_enter_open(&dict->closed)) return;
+  if(!dict_absent(dict, key)) list_remove(dict, dict->lists[hash(key)], key);
+  epoch_exit();
+}
+
+// Remove every expired entry from a dictionary. Returns the number of entries removed.
+long dict_expire(my_dict_t* dict) {
+  if(!epoch_enter_open(&dict->closed)) return 0;
+  long removed = 0;
+  for(int i=0; i<BUCKETS; i++){
+    removed += list_sweep(dict, dict->lists[i]);
+  }
+  epoch_exit();
+  return removed;
+}
+
+// Get the number of keys in a dictionary (exact once writers are quiescent)
+long dict_size(my_dict_t* dict) {
+  if(!epoch_enter_open(&dict->closed)) return 0;
+  long size = counter_read(&dict->count);
+  epoch_exit();
+  return size;
+}
+
+// Get the average number of keys per bucket (exact once writers are quiescent)
+double dict_load_factor(my_dict_t* dict) {
+  if(!epoch_enter_open(&dict->closed)) return 0;
+  double load = (double) counter_read(&dict->count) / BUCKETS;
+  epoch_exit();
+  return load;
+}
+
+// Read a dictionary's hit, miss, eviction, expiry, filter and read cache counts
+void dict_get_stats(my_dict_t* dict, dict_stats_t* stats) {
+  if(!epoch_enter_open(&dict->closed)){
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+  stats->hits = counter_read(&dict->hits);
+  stats->misses = counter_read(&dict->misses);
+  stats->evictions = counter_read(&dict->evictions);
+  stats->expirations = counter_read(&dict->expirations);
+  stats->filtered = counter_read(&dict->filtered);
+  stats->cached = counter_read(&dict->cached);
+  epoch_exit();
+}
+
+// Bulk loading: dict_bulk_load builds bucket chains in parallel without taking any locks.
+// Phase 1 splits the pairs evenly across workers to hash them and counting-sort them by
+// bucket: each worker counts its share per bucket, a prefix sum over (bucket, worker) gives
+// every worker its own run of each bucket's range, and each worker then scatters its share
+// into those runs. Since shares are contiguous and scattered in order, every bucket's pairs
+// stay in input order. Phase 2 gives each worker a fixed set of buckets, so no two workers
+// ever touch the same chain, and a worker only walks the pairs of its own buckets. Within a
+// bucket, duplicate keys are found with a temporary open-addressing table instead of walking
+// the chain for every insert. Pairs are applied in input order, so later duplicates win,
+// exactly as a sequence of dict_set calls would.
+
+typedef struct bulk_job {
+  my_dict_t *dict;
+  const dict_pair_t *pairs;
+  long n;
+  int *buckets; // Bucket of every pair, filled in phase 1
+  long *order;  // Pair indices sorted by bucket, filled in phase 1
+  long *starts; // Where each bucket's run begins in order; BUCKETS + 1 entries
+  long next[BUCKETS]; // Pairs this worker hashed into each bucket, then its next slot in order
+  int worker, workers;
+} bulk_job_t;
+
+// Find the table slot for key: either the slot holding its node or the empty slot it belongs in
+static node_t** bulk_slot(node_t** table, unsigned long mask, const char* key){
+  for(unsigned long i = fnv_hash(key) & mask;; i = (i + 1) & mask){
+    if(table[i] == NULL || strcmp(table[i]->key, key) == 0) return &table[i];
+  }
+}
+
+// Phase 1a: hash this worker's share of the pairs and count them per bucket
+static void* bulk_hash_worker(void* arg){
+  bulk_job_t *job = (bulk_job_t*) arg;
+  long start = job->n * job->worker / job->workers;
+  long end = job->n * (job->worker + 1) / job->workers;
+  memset(job->next, 0, sizeof(job->next));
+  for(long i = start; i < end; i++){
+    int b = hash(job->pairs[i].key);
+    job->buckets[i] = b;
+    job->next[b]++;
+  }
+  return NULL;
+}
+
+// Phase 1b: scatter this worker's share of the pairs into its runs of the bucket ranges
+static void* bulk_sort_worker(void* arg){
+  bulk_job_t *job = (bulk_job_t*) arg;
+  long start = job->n * job->worker / job->workers;
+  long end = job->n * (job->worker + 1) / job->workers;
+  for(long i = start; i < end; i++){
+    job->order[job->next[job->buckets[i]]++] = i;
+  }
+  return NULL;
+}
+
+// Phase 2: merge every pair belonging to this worker's buckets into their chains
+static void* bulk_build_worker(void* arg){
+  bulk_job_t *job = (bulk_job_t*) arg;
+  for(int b = job->worker; b < BUCKETS; b += job->workers){
+    list_t *list = job->dict->lists[b];
+    long first = job->starts[b], last = job->starts[b + 1];
+    // Size the table for the chain plus every incoming pair, at most half full
+    long entries = list->entries + (last - first);
+    unsigned long size = 16;
+    while(size < 2 * (unsigned long) entries) size *= 2;
+    node_t **table = (node_t**) calloc(size, sizeof(node_t*));
+    assert(table != NULL);
+
+    for(node_t *current = list->head; current != NULL; current = current->child){
+      *bulk_slot(table, size - 1, current->key) = current;
+    }
+    long added = 0;
+    for(long i = first; i < last; i++){
+      const dict_pair_t *pair = &job->pairs[job->order[i]];
+      node_t **slot = bulk_slot(table, size - 1, pair->key);
+      if(list->feed != NULL) feed_append(list->feed, FEED_SET, feed_key(pair->key), pair->val, 0);
+      if(*slot != NULL){ // Duplicate key: later pairs win
+        (*slot)->val = pair->val;
+        (*slot)->expires = 0;
+        continue;
+      }
+      *slot = node_new(job->dict, list, pair->key, pair->val, 0);
+      added++;
+    }
+    free(table);
+    counter_add(&job->dict->count, added);
+    list_changed(list); // Values of keys already present may have changed
+  }
+  return NULL;
+}
+
+// Run one phase of a bulk load on every worker and wait for all of them
+static void bulk_run(bulk_job_t* jobs, int workers, void* (*phase)(void*)){
+  pthread_t threads[BUCKETS];
+  for(int w = 1; w < workers; w++){
+    if(pthread_create(&threads[w], NULL, phase, &jobs[w]) != 0) perror("Could not create thread");
+  }
+  phase(&jobs[0]); // The calling thread is worker 0
+  for(int w = 1; w < workers; w++){
+    if(pthread_join(threads[w], NULL) != 0) perror("Could not exit thread");
+  }
+}
+
+// Load n key/value pairs into a dictionary using up to threads worker threads (0 for one per
+// CPU). No other thread may use the dictionary until this returns; it is then complete, so
+// handing its pointer to other threads publishes every pair at once.
+void dict_bulk_load(my_dict_t* dict, const dict_pair_t* pairs, long n, int threads) {
+  if(n <= 0) return;
+  int workers = threads > 0 ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if(workers > BUCKETS) workers = BUCKETS; // Buckets are the unit of phase 2 work
+  if(workers < 1) workers = 1;
+
+  int *buckets = (int*) malloc(sizeof(int) * n);
+  long *order = (long*) malloc(sizeof(long) * n);
+  assert(buckets != NULL && order != NULL);
+  long starts[BUCKETS + 1];
+  bulk_job_t jobs[BUCKETS];
+  for(int w = 0; w < workers; w++){
+    jobs[w].dict = dict;
+    jobs[w].pairs = pairs;
+    jobs[w].n = n;
+    jobs[w].buckets = buckets;
+    jobs[w].order = order;
+    jobs[w].starts = starts;
+    jobs[w].worker = w;
+    jobs[w].workers = workers;
+  }
+  bulk_run(jobs, workers, bulk_hash_worker);
+  // Turn the per-worker counts into each worker's first slot in every bucket's run
+  long offset = 0;
+  for(int b = 0; b < BUCKETS; b++){
+    starts[b] = offset;
+    for(int w = 0; w < workers; w++){
+      long count = jobs[w].next[b];
+      jobs[w].next[b] = offset;
+      offset += count;
+    }
+  }
+  starts[BUCKETS] = offset;
+  bulk_run(jobs, workers, bulk_sort_worker);
+  bulk_run(jobs, workers, bulk_build_worker);
+  free(order);
+  free(buckets);
+
+  while(dict_over_cap(dict)) dict_evict(dict); // A capped dictionary keeps its cap
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// Load key/value pairs from a file with one "key value" pair per line, as dict_bulk_load does.
+// The file is read as a stream, so pipes work too; lines without a key or a whole int value
+// are skipped. Returns the number of pairs read, or -1 if the file could not be read.
+long dict_bulk_load_file(my_dict_t* dict, const char* path, int threads) {
+  FILE *file = fopen(path, "r");
+  if(file == NULL){
+    perror("Could not open file");
+    return -1;
+  }
+
+  // Keys are packed into text, which grows as lines arrive, so pairs record where each key
+  // starts and get their pointers once text stops moving
+  char *text = NULL, *line = NULL;
+  size_t text_length = 0, text_capacity = 0, line_capacity = 0;
+  long *offsets = NULL, n = 0, pairs_capacity = 0;
+  dict_pair_t *pairs = NULL;
+  ssize_t length;
+  while((length = getline(&line, &line_capacity, file)) != -1){
+    if(length > 0 && line[length - 1] == '\n') line[--length] = '\0';
+    char *split = strrchr(line, ' ');
+    if(split == NULL || split == line) continue; // Skip malformed lines
+    char *end;
+    errno = 0;
+    long val = strtol(split + 1, &end, 10);
+    if(end == split + 1 || *end != '\0' || errno == ERANGE || val < INT_MIN || val > INT_MAX) continue;
+
+    size_t key_length = split - line;
+    if(text_length + key_length + 1 > text_capacity){
+      text_capacity = text_capacity == 0 ? 4096 : text_capacity;
+      while(text_length + key_length + 1 > text_capacity) text_capacity *= 2;
+      text = (char*) realloc(text, text_capacity);
+      assert(text != NULL);
+    }
+    if(n == pairs_capacity){
+      pairs_capacity = pairs_capacity == 0 ? 256 : pairs_capacity * 2;
+      pairs = (dict_pair_t*) realloc(pairs, sizeof(dict_pair_t) * pairs_capacity);
+      offsets = (long*) realloc(offsets, sizeof(long) * pairs_capacity);
+      assert(pairs != NULL && offsets != NULL);
+    }
+    memcpy(text + text_length, line, key_length);
+    text[text_length + key_length] = '\0';
+    offsets[n] = text_length;
+    pairs[n].val = (int) val;
+    text_length += key_length + 1;
+    n++;
+  }
+  bool failed = ferror(file);
+  if(failed) perror("Could not read file");
+  fclose(file);
+  free(line);
+
+  if(!failed){
+    for(long i = 0; i < n; i++) pairs[i].key = text + offsets[i];
+    dict_bulk_load(dict, pairs, n, threads);
+  }
+  free(offsets);
+  free(pairs);
+  free(text);
+  return failed ? -1 : n;
 }
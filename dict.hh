@@ -1,41 +1,145 @@
 #ifndef DICT_H
 #define DICT_H
 //#define MAX_KEY_SIZE 20
+#define BUCKETS 20
+#define DICT_CACHE_SLOTS 64 // Entries in each thread's read cache
+#define DICT_CACHE_KEY 32   // Longest key (with its terminator) a read cache entry can hold
 
 #include <stdbool.h>
 #include <pthread.h>
 
+#include "counter.hh"
+#include "lock.hh"
+#include "arena.hh"
+#include "filter.hh"
+#include "feed.hh"
+
 typedef struct node {
   struct node *parent, *child;
   int val;
   char *key;
+  long expires; // Monotonic time in ms after which the entry is gone, 0 for never
+  int referenced; // CLOCK bit: set on access, cleared by the eviction hand
 } node_t;
 
+// A bucket's write version, bumped by every change to the bucket. It has a line of its own so
+// readers polling it are not disturbed by traffic on the bucket lock.
+typedef struct dict_version {
+  unsigned long value;
+} __attribute__((aligned(CACHE_LINE))) dict_version_t;
+
 typedef struct list {
   node_t *head;
-  pthread_mutex_t lock;
+  my_lock_t lock;
+  arena_t *arena; // Allocator for this bucket's nodes in arena mode, NULL otherwise
+  long entries;   // Nodes in the list, so an arena list can be cleared without visiting them
+  dict_version_t *version; // Write version validating thread read caches, NULL if disabled
+  feed_shard_t *feed; // Change feed shard this bucket's mutations go to, NULL if disabled
 } list_t;
 
 typedef struct my_dict {
   list_t **lists;
+  my_counter_t count; // Number of keys, sharded so it is not a global hot spot
+  my_counter_t hits, misses, evictions, expirations, filtered, cached; // Cache statistics
+  long max_entries; // Entry cap enforced by CLOCK eviction, 0 for unbounded
+  unsigned int clock_hand; // Next bucket the eviction hand visits
+  filter_t *filter; // Membership filter consulted before bucket locks, NULL if disabled
+  dict_version_t *versions; // One write version per bucket when read caches are on, NULL otherwise
+  unsigned long cache_id; // Tags this dictionary's read cache entries, never reused
+  int closed; // Set by dict_destroy; later operations see an empty dictionary
 } my_dict_t;
 
+typedef struct dict_stats {
+  long hits, misses; // dict_get calls that found / did not find their key
+  long evictions;    // Entries removed to stay under max_entries
+  long expirations;  // Entries removed because their TTL ran out
+  long filtered;     // Lookups the membership filter answered without a bucket lock
+  long cached;       // Hits served from the calling thread's read cache, also counted in hits
+} dict_stats_t;
+
+typedef struct dict_pair {
+  const char *key;
+  int val;
+} dict_pair_t;
+
 // Initialize a dictionary
 void dict_init(my_dict_t* dict);
 
-// Destroy a dictionary
+// Initialize a dictionary that holds at most max_entries keys, evicting with CLOCK when full
+void dict_init_cache(my_dict_t* dict, long max_entries);
+
+// Initialize a dictionary whose nodes and keys are allocated from one arena per bucket,
+// so dict_clear and dict_destroy free whole arenas instead of every node (dict_clear still
+// visits each node when a membership filter or change feed must hear about its key)
+void dict_init_arena(my_dict_t* dict);
+
+// Destroy a dictionary. Operations already running on other threads finish first; later ones
+// act as on an empty dictionary, so a dictionary can be replaced online by publishing a new one
+// and then destroying the old one. The my_dict_t itself must stay allocated while threads may
+// use it.
 void dict_destroy(my_dict_t* dict);
 
+// Remove every key from a dictionary, keeping it usable
+void dict_clear(my_dict_t* dict);
+
+// Attach a counting Bloom filter sized for expected_keys keys, so lookups of absent keys can
+// return without taking a bucket lock. No other thread may use the dictionary during the call.
+void dict_enable_filter(my_dict_t* dict, long expected_keys);
+
+// Give every thread a small read cache in front of dict_get and dict_try_get, so repeated reads
+// of hot keys skip the bucket lock. Entries are validated against a per-bucket version that
+// every write bumps. No other thread may use the dictionary during the call.
+void dict_enable_read_cache(my_dict_t* dict);
+
+// Send every later mutation of a dictionary to a change feed with BUCKETS shards, one per
+// bucket, starting with a FEED_SET for every key already present. Expiry, eviction and
+// dict_clear show up as FEED_REMOVE records. No other thread may use the dictionary during the
+// call, and the feed must outlive the dictionary.
+void dict_attach_feed(my_dict_t* dict, my_feed_t* feed);
+
 // Set a value in a dictionary
 void dict_set(my_dict_t* dict, const char* key, int value);
 
+// Set a value in a dictionary that expires after ttl_ms milliseconds
+void dict_set_ttl(my_dict_t* dict, const char* key, int value, long ttl_ms);
+
 // Check if a dictionary contains a key
 bool dict_contains(my_dict_t* dict, const char* key);
 
 // Get a value in a dictionary
 int dict_get(my_dict_t* dict, const char* key);
 
+// Set a value in a dictionary unless another thread holds that key's bucket.
+// Returns true if the value was set.
+bool dict_try_set(my_dict_t* dict, const char* key, int value);
+
+// Get a value in a dictionary unless another thread holds that key's bucket.
+// Returns true and stores the value (-1 if absent) if the lookup ran.
+bool dict_try_get(my_dict_t* dict, const char* key, int* value);
+
 // Remove a value from a dictionary
 void dict_remove(my_dict_t* dict, const char* key);
 
+// Remove every expired entry from a dictionary. Returns the number of entries removed.
+long dict_expire(my_dict_t* dict);
+
+// Get the number of keys in a dictionary (exact once writers are quiescent)
+long dict_size(my_dict_t* dict);
+
+// Get the average number of keys per bucket (exact once writers are quiescent)
+double dict_load_factor(my_dict_t* dict);
+
+// Read a dictionary's hit, miss, eviction, expiry, filter and read cache counts
+void dict_get_stats(my_dict_t* dict, dict_stats_t* stats);
+
+// Load n key/value pairs into a dictionary using up to threads worker threads (0 for one per
+// CPU). No other thread may use the dictionary until this returns; it is then complete, so
+// handing its pointer to other threads publishes every pair at once.
+void dict_bulk_load(my_dict_t* dict, const dict_pair_t* pairs, long n, int threads);
+
+// Load key/value pairs from a file with one "key value" pair per line, as dict_bulk_load does.
+// The file is read as a stream, so pipes work too; lines without a key or a whole int value
+// are skipped. Returns the number of pairs read, or -1 if the file could not be read.
+long dict_bulk_load_file(my_dict_t* dict, const char* path, int threads);
+
 #endif
@@ -0,0 +1,200 @@
+#include "epoch.hh"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+
+// Epoch-based reclamation (Fraser): a thread announces the global epoch when it enters a
+// critical section. The global epoch can only advance once every active thread has announced
+// the current one, so an object retired in epoch e can no longer be referenced once the global
+// epoch reaches e + 2. Readers pay two stores to their own cache line per critical section.
+// Structures that close for teardown (epoch_enter_open / epoch_close) are entered far more
+// often than they are closed, so where the kernel has membarrier the closing thread issues a
+// barrier on every running thread instead, and entering them needs no fence at all.
+// Threads that find every record claimed share one overflow record under a mutex. Its epoch is
+// set only by the first thread to enter, so it is never newer than any sharer's; that keeps it
+// safe, at the cost of a lock per critical section, and the global epoch cannot move far until
+// a moment when no sharer is inside.
+
+static long global_epoch = 0;
+static epoch_record_t records[EPOCH_THREADS];
+static __thread epoch_record_t *my_record = NULL; // This thread's record, claimed on first use
+
+static epoch_record_t overflow; // Shared by threads that found every record claimed
+static pthread_mutex_t overflow_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread int overflow_depth = 0; // This thread's nesting depth in the overflow record
+
+static pthread_key_t record_key;
+static pthread_once_t record_once = PTHREAD_ONCE_INIT;
+
+static pthread_once_t barrier_once = PTHREAD_ONCE_INIT;
+static bool use_membarrier = false;
+
+// Register for expedited membarrier, if the kernel has it
+static void epoch_barrier_init(){
+  use_membarrier = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+}
+
+// Give a thread's record back when it exits. Its limbo list stays with the record.
+static void epoch_release(void* arg){
+  epoch_record_t *record = (epoch_record_t*) arg;
+  __atomic_store_n(&record->in_use, 0, __ATOMIC_RELEASE);
+}
+
+// Create the key whose destructor releases records
+static void epoch_key_init(){
+  if(pthread_key_create(&record_key, epoch_release) != 0) perror("Could not create thread key");
+}
+
+// Claim a free record for the calling thread, or share the overflow record if none is free
+static epoch_record_t* epoch_record(){
+  if(my_record != NULL) return my_record;
+  pthread_once(&record_once, epoch_key_init);
+  for(int i=0; i<EPOCH_THREADS; i++){
+    int expected = 0;
+    if(__atomic_compare_exchange_n(&records[i].in_use, &expected, 1, false,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+      my_record = &records[i];
+      pthread_setspecific(record_key, my_record);
+      return my_record;
+    }
+  }
+  my_record = &overflow;
+  return my_record;
+}
+
+// Advance the global epoch if every active thread has observed it. Returns the global epoch.
+static long epoch_try_advance(){
+  long current = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+  for(int i=0; i<EPOCH_THREADS; i++){
+    if(__atomic_load_n(&records[i].active, __ATOMIC_SEQ_CST) > 0 &&
+       __atomic_load_n(&records[i].epoch, __ATOMIC_SEQ_CST) != current){
+      return current; // Someone is still in an older epoch
+    }
+  }
+  if(__atomic_load_n(&overflow.active, __ATOMIC_SEQ_CST) > 0 &&
+     __atomic_load_n(&overflow.epoch, __ATOMIC_SEQ_CST) != current){
+    return current;
+  }
+  __atomic_compare_exchange_n(&global_epoch, &current, current + 1, false,
+                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+}
+
+// Free everything in a record's limbo list that is at least two epochs old
+static void epoch_collect(epoch_record_t* record, long current){
+  epoch_garbage_t **link = &record->limbo;
+  while(*link != NULL && (*link)->epoch + 2 > current) link = &(*link)->next;
+  epoch_garbage_t *garbage = *link; // Everything from here on is older still
+  *link = NULL;
+  while(garbage != NULL){
+    epoch_garbage_t *next = garbage->next;
+    garbage->free_fn(garbage->ptr);
+    free(garbage);
+    garbage = next;
+  }
+}
+
+// Announce the calling thread in the current epoch. Returns true if this is the outermost
+// critical section, which still needs a fence before it reads anything shared.
+static bool epoch_announce(){
+  epoch_record_t *record = epoch_record();
+  if(record == &overflow){
+    pthread_mutex_lock(&overflow_lock);
+    if(overflow.active == 0){
+      __atomic_store_n(&overflow.epoch, __atomic_load_n(&global_epoch, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&overflow.active, overflow.active + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&overflow_lock);
+    return ++overflow_depth == 1;
+  }
+  if(record->active > 0){ // Nested: the outer section already protects us
+    __atomic_store_n(&record->active, record->active + 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  __atomic_store_n(&record->epoch, __atomic_load_n(&global_epoch, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+  __atomic_store_n(&record->active, 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+// Enter a read-side critical section. Shared nodes read inside it stay allocated until exit.
+void epoch_enter() {
+  if(epoch_announce()) __atomic_thread_fence(__ATOMIC_SEQ_CST); // Announce before reading any shared pointer
+}
+
+// Leave a read-side critical section
+void epoch_exit() {
+  epoch_record_t *record = my_record;
+  if(record == &overflow){
+    overflow_depth--;
+    pthread_mutex_lock(&overflow_lock);
+    __atomic_store_n(&overflow.active, overflow.active - 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&overflow_lock);
+    return;
+  }
+  __atomic_store_n(&record->active, record->active - 1, __ATOMIC_RELEASE);
+}
+
+// Free ptr with free_fn once every thread that might still hold it has left its critical section
+void epoch_retire(void* ptr, epoch_free_t free_fn) {
+  epoch_record_t *record = epoch_record();
+  epoch_garbage_t *garbage = (epoch_garbage_t*) malloc(sizeof(epoch_garbage_t));
+  assert(garbage != NULL);
+  garbage->ptr = ptr;
+  garbage->free_fn = free_fn;
+  if(record == &overflow) pthread_mutex_lock(&overflow_lock);
+  garbage->epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+  garbage->next = record->limbo; // Newest first
+  record->limbo = garbage;
+  if(++record->retired >= EPOCH_BATCH){
+    record->retired = 0;
+    epoch_collect(record, epoch_try_advance());
+  }
+  if(record == &overflow) pthread_mutex_unlock(&overflow_lock);
+}
+
+// Wait until every critical section that was running when this was called has ended
+void epoch_synchronize() {
+  epoch_record_t *record = epoch_record();
+  // Waiting from inside a critical section would deadlock
+  assert(record == &overflow ? overflow_depth == 0 : record->active == 0);
+  long target = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST) + 2;
+  while(epoch_try_advance() < target) sched_yield();
+  if(record == &overflow) pthread_mutex_lock(&overflow_lock);
+  epoch_collect(record, target);
+  if(record == &overflow) pthread_mutex_unlock(&overflow_lock);
+}
+
+// Enter a critical section on a structure that can be closed for teardown. Returns false,
+// without entering, if *closed is already set.
+bool epoch_enter_open(const int* closed) {
+  pthread_once(&barrier_once, epoch_barrier_init);
+  // The announcement must be visible before closed is read, so epoch_close either waits for
+  // us or we see closed. With membarrier, epoch_close supplies the fence on our behalf.
+  if(epoch_announce()){
+    if(use_membarrier) __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    else __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  }
+  SCHED_POINT();
+  if(__atomic_load_n(closed, __ATOMIC_RELAXED)){
+    epoch_exit();
+    return false;
+  }
+  return true;
+}
+
+// Close a structure for teardown: set *closed, then wait until every operation that entered
+// before it was set has left. The structure can then be freed.
+void epoch_close(int* closed) {
+  pthread_once(&barrier_once, epoch_barrier_init);
+  __atomic_store_n(closed, 1, __ATOMIC_SEQ_CST);
+  if(use_membarrier && syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) != 0){
+    perror("Could not issue membarrier");
+  }
+  epoch_synchronize();
+}
@@ -0,0 +1,51 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdbool.h>
+
+#include "lock.hh"
+
+#define EPOCH_THREADS 256 // Threads with a record of their own; any more share a slower one
+#define EPOCH_BATCH 64    // Retirements between attempts to advance the global epoch
+
+// Frees one retired object
+typedef void (*epoch_free_t)(void* ptr);
+
+// An object unlinked from a shared structure, waiting for readers to move on
+typedef struct epoch_garbage {
+  void *ptr;
+  epoch_free_t free_fn;
+  long epoch; // Global epoch when the object was retired
+  struct epoch_garbage *next;
+} epoch_garbage_t;
+
+// One thread's announcement, on its own cache line
+typedef struct epoch_record {
+  long epoch;     // Global epoch this thread observed on entry
+  int active;     // Nesting depth of epoch_enter calls
+  int in_use;     // Claimed by a live thread
+  int retired;    // Retirements since the last advance attempt
+  epoch_garbage_t *limbo; // Objects retired by this record's threads, oldest last
+} __attribute__((aligned(CACHE_LINE))) epoch_record_t;
+
+// Enter a read-side critical section. Shared nodes read inside it stay allocated until exit.
+void epoch_enter();
+
+// Leave a read-side critical section
+void epoch_exit();
+
+// Free ptr with free_fn once every thread that might still hold it has left its critical section
+void epoch_retire(void* ptr, epoch_free_t free_fn);
+
+// Wait until every critical section that was running when this was called has ended
+void epoch_synchronize();
+
+// Enter a critical section on a structure that can be closed for teardown. Returns false,
+// without entering, if *closed is already set.
+bool epoch_enter_open(const int* closed);
+
+// Close a structure for teardown: set *closed, then wait until every operation that entered
+// before it was set has left. The structure can then be freed.
+void epoch_close(int* closed);
+
+#endif
@@ -0,0 +1,231 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include "feed.hh"
+
+#define NUM_SHARDS 8
+#define APPENDS_PER_SHARD 100000
+
+/****** Feed Invariants ******/
+
+// Invariant 1
+// Every record appended to a shard is consumed exactly once, in the order it was appended,
+// and a shard's sequence numbers count up from 1 without gaps.
+
+// Invariant 2
+// In durable mode, every record a subscriber has seen can be replayed from the log file, in the
+// same order within each shard.
+
+// Invariant 3
+// Once feed_wait_durable returns true for a record, the record can be replayed from the log file.
+
+// Invariant 4
+// In durable mode, a record that could not be written to the log file is never applied.
+
+/****** Begin Tests ******/
+
+typedef struct seen {
+  unsigned long last_seq[NUM_SHARDS];
+  long records;
+  bool in_order;
+} seen_t;
+
+// Subscriber callback for tests: check each shard's records arrive in sequence
+void check_record(const feed_record_t* record, void* arg){
+  seen_t *seen = (seen_t*) arg;
+  if(record->seq != seen->last_seq[record->shard] + 1) seen->in_order = false;
+  if(record->val != (int) record->seq) seen->in_order = false;
+  if(strcmp(record->key, "k") != 0) seen->in_order = false;
+  seen->last_seq[record->shard] = record->seq;
+  seen->records++;
+}
+
+// Worker thread for tests: the only producer of one shard
+void* append_worker(void* arg){
+  feed_shard_t *shard = (feed_shard_t*) arg;
+  for(int i=1; i <= APPENDS_PER_SHARD; i++){
+    feed_append(shard, FEED_SET, feed_key("k"), i, 0);
+  }
+  pthread_exit(0);
+}
+
+// Run NUM_SHARDS producers against a subscriber, checking what the subscriber saw
+static void run_producers(my_feed_t* feed, seen_t* seen){
+  memset(seen, 0, sizeof(seen_t));
+  seen->in_order = true;
+  feed_subscribe(feed, check_record, seen);
+  pthread_t workers[NUM_SHARDS];
+  for(int i=0; i < NUM_SHARDS; i++){
+    if(pthread_create(&workers[i], NULL, append_worker, &feed->shards[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_SHARDS; i++){ // Wait for threads to exit
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+  feed_unsubscribe(feed);
+}
+
+// A test of invariant 1: concurrent producers and a subscriber
+TEST(FeedTest, Invariant1){
+  my_feed_t feed;
+  ASSERT_TRUE(feed_init(&feed, NUM_SHARDS, NULL));
+  seen_t seen;
+  run_producers(&feed, &seen);
+  ASSERT_TRUE(seen.in_order);
+  ASSERT_EQ(NUM_SHARDS * APPENDS_PER_SHARD, seen.records);
+  for(int i=0; i < NUM_SHARDS; i++){
+    ASSERT_EQ(APPENDS_PER_SHARD, (long) seen.last_seq[i]);
+  }
+  feed_destroy(&feed);
+}
+
+// A test of invariant 2: the log file replays what the subscriber saw
+TEST(FeedTest, Invariant2){
+  char path[] = "/tmp/feed-tests-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  my_feed_t feed;
+  ASSERT_TRUE(feed_init(&feed, NUM_SHARDS, path));
+  seen_t seen;
+  run_producers(&feed, &seen);
+  ASSERT_TRUE(seen.in_order);
+  feed_destroy(&feed);
+
+  seen_t replayed;
+  memset(&replayed, 0, sizeof(replayed));
+  replayed.in_order = true;
+  ASSERT_EQ(NUM_SHARDS * APPENDS_PER_SHARD, feed_replay(path, check_record, &replayed));
+  ASSERT_TRUE(replayed.in_order);
+  unlink(path);
+}
+
+// Consuming by hand in small batches, and destroying a feed that still holds records
+TEST(FeedTest, BasicFeedOps){
+  my_feed_t feed;
+  ASSERT_TRUE(feed_init(&feed, 2, NULL));
+  seen_t seen;
+  memset(&seen, 0, sizeof(seen));
+  seen.in_order = true;
+  ASSERT_EQ(0, feed_consume(&feed, check_record, &seen, 10));
+
+  for(int i=1; i <= FEED_SEG * 2; i++){ // Ends exactly on a segment boundary
+    ASSERT_EQ((unsigned long) i, feed_append(&feed.shards[0], FEED_SET, feed_key("k"), i, 0));
+  }
+  feed_append(&feed.shards[1], FEED_SET, feed_key("k"), 1, 0);
+  ASSERT_EQ(10, feed_consume(&feed, check_record, &seen, 10));
+  ASSERT_EQ(FEED_SEG * 2 - 10 + 1, feed_consume(&feed, check_record, &seen, FEED_SEG * 4));
+  ASSERT_EQ(0, feed_consume(&feed, check_record, &seen, 10));
+  ASSERT_TRUE(seen.in_order);
+
+  feed_append(&feed.shards[0], FEED_SET, feed_key("k"), FEED_SEG * 2 + 1, 0); // First record of a new segment
+  ASSERT_EQ(1, feed_consume(&feed, check_record, &seen, 10));
+  ASSERT_TRUE(seen.in_order);
+
+  for(int i=0; i < FEED_SEG * 3; i++){ // Left for feed_destroy
+    feed_append(&feed.shards[1], FEED_REMOVE, feed_key("k"), 0, 0);
+  }
+  feed_destroy(&feed);
+}
+
+typedef struct durable_args {
+  my_feed_t *feed;
+  int shard;
+  bool durable; // Every wait returned true
+} durable_args_t;
+
+// Worker thread for tests: append to one shard, waiting for each record to be durable
+void* durable_worker(void* arg){
+  durable_args_t *args = (durable_args_t*) arg;
+  for(int i=1; i <= 100; i++){
+    unsigned long seq = feed_append(&args->feed->shards[args->shard], FEED_SET, feed_key("k"), i, 0);
+    if(!feed_wait_durable(args->feed, args->shard, seq)) args->durable = false;
+  }
+  pthread_exit(0);
+}
+
+// Helper for tests: count the records in a log file
+void count_record(const feed_record_t* record, void* arg){
+  (*(long*) arg)++;
+}
+
+// A test of invariant 3: writers that wait see their records on disk, sharing syncs
+TEST(FeedTest, Invariant3){
+  char path[] = "/tmp/feed-tests-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  my_feed_t feed;
+  ASSERT_TRUE(feed_init(&feed, NUM_SHARDS, path));
+  seen_t seen;
+  memset(&seen, 0, sizeof(seen));
+  seen.in_order = true;
+  feed_subscribe(&feed, check_record, &seen);
+  durable_args_t args[NUM_SHARDS];
+  pthread_t workers[NUM_SHARDS];
+  for(int i=0; i < NUM_SHARDS; i++){
+    args[i].feed = &feed;
+    args[i].shard = i;
+    args[i].durable = true;
+    if(pthread_create(&workers[i], NULL, durable_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_SHARDS; i++){
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+    ASSERT_TRUE(args[i].durable);
+  }
+  long records = 0; // Read back while the subscriber is still running
+  ASSERT_EQ(NUM_SHARDS * 100, feed_replay(path, count_record, &records));
+
+  feed_append(&feed.shards[0], FEED_REMOVE, feed_key("k"), 0, 0);
+  ASSERT_TRUE(feed_wait_appended(&feed));
+  ASSERT_EQ(NUM_SHARDS * 100 + 1, feed_replay(path, count_record, &records));
+  feed_unsubscribe(&feed);
+  feed_destroy(&feed);
+  unlink(path);
+}
+
+// Replay stops at a record whose key length cannot be right
+TEST(FeedTest, CorruptReplay){
+  char path[] = "/tmp/feed-tests-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  my_feed_t feed;
+  ASSERT_TRUE(feed_init(&feed, 1, path));
+  feed_append(&feed.shards[0], FEED_SET, feed_key("k"), 1, 0);
+  seen_t seen;
+  memset(&seen, 0, sizeof(seen));
+  seen.in_order = true;
+  ASSERT_EQ(1, feed_consume(&feed, check_record, &seen, 10));
+  feed_destroy(&feed);
+
+  FILE *file = fopen(path, "a");
+  int garbage[16];
+  for(int i=0; i < 16; i++) garbage[i] = -1; // A key length of -1
+  fwrite(garbage, sizeof(garbage), 1, file);
+  fclose(file);
+  long records = 0;
+  ASSERT_EQ(1, feed_replay(path, count_record, &records));
+  unlink(path);
+}
+
+// A test of invariant 4: a log file that cannot be written drops its batch and every later one
+TEST(FeedTest, Invariant4){
+  my_feed_t feed;
+  ASSERT_TRUE(feed_init(&feed, 1, "/dev/full")); // Every write fails with ENOSPC
+  seen_t seen;
+  memset(&seen, 0, sizeof(seen));
+  seen.in_order = true;
+  unsigned long seq = feed_append(&feed.shards[0], FEED_SET, feed_key("k"), 1, 0);
+  ASSERT_EQ(1, feed_consume(&feed, check_record, &seen, 10));
+  ASSERT_EQ(0, seen.records);
+  ASSERT_FALSE(feed_wait_durable(&feed, 0, seq));
+
+  feed_append(&feed.shards[0], FEED_SET, feed_key("k"), 2, 0);
+  ASSERT_EQ(1, feed_consume(&feed, check_record, &seen, 10));
+  ASSERT_EQ(0, seen.records);
+  ASSERT_FALSE(feed_wait_appended(&feed));
+  feed_destroy(&feed);
+}
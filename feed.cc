@@ -0,0 +1,296 @@
+#include "feed.hh"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Change feed implementation: every shard is a single-producer, single-consumer log made of
+// linked segments of FEED_SEG records. The producer fills the next record in place and then
+// publishes it by advancing appended with a release store; the consumer reads up to appended.
+// The consumer frees a segment only when it reaches the first record of the next one, since
+// the producer links a segment lazily with its first record. Neither side ever waits for the
+// other, and the log grows while nobody consumes it.
+// In durable mode the consumer writes a whole batch to the log file with one write and one
+// fdatasync (group commit) before passing any of its records on. It then advances each shard's
+// durable count and wakes writers blocked in feed_wait_durable, so a writer that needs its
+// record on disk shares that sync with every other record in the batch. A batch that fails to
+// sync is dropped, not applied, and so is everything after it, so a subscriber never gets ahead
+// of the log.
+
+// Fixed part of a record in the log file; the key bytes follow it
+typedef struct feed_entry {
+  unsigned long seq;
+  int shard, op, val, key_length;
+  long ttl_ms;
+} feed_entry_t;
+
+// Allocate an empty segment
+static feed_segment_t* feed_segment_new(){
+  feed_segment_t *seg = (feed_segment_t*) malloc(sizeof(feed_segment_t));
+  if(seg == NULL) perror("Could not allocate space");
+  seg->next = NULL;
+  return seg;
+}
+
+// Initialize a change feed with the given number of shards. If path is not NULL, records are
+// appended to that file, and synced, before a subscriber sees them. Returns false if the file
+// could not be opened.
+bool feed_init(my_feed_t* feed, int shards, const char* path) {
+  feed->fd = -1;
+  if(path != NULL){
+    feed->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(feed->fd == -1){
+      perror("Could not open file");
+      return false;
+    }
+  }
+  feed->shards = (feed_shard_t*) aligned_alloc(CACHE_LINE, sizeof(feed_shard_t) * shards);
+  assert(feed->shards != NULL);
+  feed->nshards = shards;
+  for(int i=0; i<shards; i++){
+    feed_shard_t *shard = &feed->shards[i];
+    shard->tail_seg = shard->head_seg = feed_segment_new();
+    shard->appended = shard->consumed = shard->batch_end = shard->durable = 0;
+    shard->index = i;
+  }
+  feed->buffer = NULL;
+  feed->buffer_size = 0;
+  feed->stopping = false;
+  feed->failed = false;
+  pthread_mutex_init(&feed->durable_lock, NULL);
+  pthread_cond_init(&feed->durable_cond, NULL);
+  return true;
+}
+
+// Destroy a change feed, dropping any records that were never consumed
+void feed_destroy(my_feed_t* feed) {
+  for(int i=0; i<feed->nshards; i++){
+    feed_shard_t *shard = &feed->shards[i];
+    feed_segment_t *seg = shard->head_seg;
+    for(unsigned long n = shard->consumed; n < shard->appended; n++){
+      if(n > 0 && n % FEED_SEG == 0){
+        feed_segment_t *next = seg->next;
+        free(seg);
+        seg = next;
+      }
+      free(seg->records[n % FEED_SEG].key);
+    }
+    free(seg); // The tail segment
+  }
+  free(feed->shards);
+  free(feed->buffer);
+  pthread_mutex_destroy(&feed->durable_lock);
+  pthread_cond_destroy(&feed->durable_cond);
+  if(feed->fd != -1) close(feed->fd);
+}
+
+// Copy a key for feed_append. Writers copy before taking the lock that serializes their appends,
+// so the allocation stays out of the critical section.
+char* feed_key(const char* key) {
+  char *copy = strdup(key);
+  assert(copy != NULL);
+  return copy;
+}
+
+// Append a record to a shard's log, taking ownership of key, which must come from malloc (see
+// feed_key). Returns its sequence number. Appends to one shard must not run concurrently; the
+// dictionary appends while holding the shard's bucket lock.
+unsigned long feed_append(feed_shard_t* shard, int op, char* key, int val, long ttl_ms) {
+  unsigned long n = shard->appended; // Only this producer writes it
+  if(n > 0 && n % FEED_SEG == 0){ // Current segment is full: link a new one
+    feed_segment_t *seg = feed_segment_new();
+    __atomic_store_n(&shard->tail_seg->next, seg, __ATOMIC_RELEASE);
+    shard->tail_seg = seg;
+  }
+  feed_record_t *record = &shard->tail_seg->records[n % FEED_SEG];
+  record->seq = n + 1;
+  record->shard = shard->index;
+  record->op = op;
+  record->val = val;
+  record->ttl_ms = ttl_ms;
+  record->key = key;
+  __atomic_store_n(&shard->appended, n + 1, __ATOMIC_RELEASE); // Publish the record
+  return n + 1;
+}
+
+// feed_batch_write serializes one shard's share of the batch into the feed's buffer.
+// Returns the new length of the buffer.
+static long feed_batch_write(my_feed_t* feed, feed_shard_t* shard, long length){
+  feed_segment_t *seg = shard->head_seg;
+  for(unsigned long n = shard->consumed; n < shard->batch_end; n++){
+    if(n > 0 && n % FEED_SEG == 0) seg = __atomic_load_n(&seg->next, __ATOMIC_ACQUIRE);
+    feed_record_t *record = &seg->records[n % FEED_SEG];
+    feed_entry_t entry = {record->seq, record->shard, record->op, record->val,
+                          (int) strlen(record->key), record->ttl_ms};
+    long needed = length + sizeof(entry) + entry.key_length;
+    if(needed > feed->buffer_size){
+      feed->buffer_size = needed * 2;
+      feed->buffer = (char*) realloc(feed->buffer, feed->buffer_size);
+      assert(feed->buffer != NULL);
+    }
+    memcpy(feed->buffer + length, &entry, sizeof(entry));
+    memcpy(feed->buffer + length + sizeof(entry), record->key, entry.key_length);
+    length = needed;
+  }
+  return length;
+}
+
+// feed_sync writes the buffer to the log file and waits until it is on disk.
+// Returns false if it could not.
+static bool feed_sync(my_feed_t* feed, long length){
+  for(long written = 0; written < length;){
+    ssize_t n = write(feed->fd, feed->buffer + written, length - written);
+    if(n == -1){
+      perror("Could not write file");
+      return false;
+    }
+    written += n;
+  }
+  if(fdatasync(feed->fd) == -1){
+    perror("Could not sync file");
+    return false;
+  }
+  return true;
+}
+
+// feed_mark_durable publishes the end of the batch as durable and wakes waiting writers
+static void feed_mark_durable(my_feed_t* feed, bool failed){
+  pthread_mutex_lock(&feed->durable_lock);
+  if(failed) __atomic_store_n(&feed->failed, true, __ATOMIC_RELEASE);
+  for(int i=0; i<feed->nshards; i++){
+    feed_shard_t *shard = &feed->shards[i];
+    __atomic_store_n(&shard->durable, shard->batch_end, __ATOMIC_RELEASE);
+  }
+  pthread_cond_broadcast(&feed->durable_cond);
+  pthread_mutex_unlock(&feed->durable_lock);
+}
+
+// Take up to max published records from every shard, passing each to apply in shard order.
+// In durable mode the whole batch is written and synced first. If the log file cannot be
+// written, the batch and every later one are dropped without being applied, and
+// feed_wait_durable reports the failure. Only one thread may consume at a time.
+// Returns the number of records taken.
+long feed_consume(my_feed_t* feed, feed_apply_t apply, void* arg, long max) {
+  // Fix the batch first, so the records synced are exactly the ones applied
+  long taken = 0;
+  for(int i=0; i<feed->nshards; i++){
+    feed_shard_t *shard = &feed->shards[i];
+    unsigned long available = __atomic_load_n(&shard->appended, __ATOMIC_ACQUIRE) - shard->consumed;
+    if((long) available > max - taken) available = max - taken;
+    shard->batch_end = shard->consumed + available;
+    taken += available;
+  }
+  if(taken == 0) return 0;
+
+  // Once the log has a hole, nothing after it may be applied
+  bool failed = __atomic_load_n(&feed->failed, __ATOMIC_ACQUIRE);
+  if(feed->fd != -1 && !failed){ // Group commit
+    long length = 0;
+    for(int i=0; i<feed->nshards; i++){
+      length = feed_batch_write(feed, &feed->shards[i], length);
+    }
+    failed = !feed_sync(feed, length);
+  }
+  if(feed->fd != -1) feed_mark_durable(feed, failed);
+
+  for(int i=0; i<feed->nshards; i++){
+    feed_shard_t *shard = &feed->shards[i];
+    for(; shard->consumed < shard->batch_end; shard->consumed++){
+      unsigned long n = shard->consumed;
+      if(n > 0 && n % FEED_SEG == 0){ // Moved past a segment: the producer is done with it
+        feed_segment_t *next = __atomic_load_n(&shard->head_seg->next, __ATOMIC_ACQUIRE);
+        free(shard->head_seg);
+        shard->head_seg = next;
+      }
+      feed_record_t *record = &shard->head_seg->records[n % FEED_SEG];
+      if(!failed) apply(record, arg);
+      free(record->key);
+    }
+  }
+  if(feed->fd == -1) feed_mark_durable(feed, false);
+  return taken;
+}
+
+// Wait until record seq of a shard has been synced to the log file, or, without one, applied.
+// Something must be consuming the feed. Returns false if the log file could not be written.
+bool feed_wait_durable(my_feed_t* feed, int shard, unsigned long seq) {
+  feed_shard_t *s = &feed->shards[shard];
+  if(__atomic_load_n(&s->durable, __ATOMIC_ACQUIRE) >= seq){
+    return !__atomic_load_n(&feed->failed, __ATOMIC_ACQUIRE);
+  }
+  pthread_mutex_lock(&feed->durable_lock);
+  while(!feed->failed && __atomic_load_n(&s->durable, __ATOMIC_ACQUIRE) < seq){
+    pthread_cond_wait(&feed->durable_cond, &feed->durable_lock);
+  }
+  bool durable = !feed->failed;
+  pthread_mutex_unlock(&feed->durable_lock);
+  return durable;
+}
+
+// Wait, as feed_wait_durable does, for every record appended to any shard before the call
+bool feed_wait_appended(my_feed_t* feed) {
+  bool durable = true;
+  for(int i=0; i<feed->nshards; i++){
+    unsigned long appended = __atomic_load_n(&feed->shards[i].appended, __ATOMIC_ACQUIRE);
+    if(!feed_wait_durable(feed, i, appended)) durable = false;
+  }
+  return durable;
+}
+
+// Subscriber thread: consume in batches until asked to stop, then drain what is left
+static void* feed_subscriber(void* arg){
+  my_feed_t *feed = (my_feed_t*) arg;
+  while(!__atomic_load_n(&feed->stopping, __ATOMIC_ACQUIRE)){
+    if(feed_consume(feed, feed->apply, feed->arg, FEED_BATCH) == 0) usleep(FEED_IDLE_US);
+  }
+  while(feed_consume(feed, feed->apply, feed->arg, FEED_BATCH) > 0);
+  return NULL;
+}
+
+// Start a subscriber thread that consumes the feed in batches, passing each record to apply
+void feed_subscribe(my_feed_t* feed, feed_apply_t apply, void* arg) {
+  feed->apply = apply;
+  feed->arg = arg;
+  feed->stopping = false;
+  if(pthread_create(&feed->subscriber, NULL, feed_subscriber, feed) != 0) perror("Could not create thread");
+}
+
+// Stop the subscriber thread once it has consumed every record appended before the call
+void feed_unsubscribe(my_feed_t* feed) {
+  __atomic_store_n(&feed->stopping, true, __ATOMIC_RELEASE);
+  if(pthread_join(feed->subscriber, NULL) != 0) perror("Could not exit thread");
+}
+
+// Pass every record in a durable feed's log file to apply, in the order they were written.
+// Returns the number of records read, or -1 if the file could not be read.
+long feed_replay(const char* path, feed_apply_t apply, void* arg) {
+  FILE *file = fopen(path, "r");
+  if(file == NULL){
+    perror("Could not open file");
+    return -1;
+  }
+  long n = 0;
+  feed_entry_t entry;
+  while(fread(&entry, sizeof(entry), 1, file) == 1){
+    if(entry.key_length < 0 || entry.key_length > FEED_MAX_KEY){
+      fprintf(stderr, "Corrupt record in %s\n", path);
+      break;
+    }
+    char *key = (char*) malloc(entry.key_length + 1);
+    assert(key != NULL);
+    if((int) fread(key, 1, entry.key_length, file) != entry.key_length){ // Torn final record
+      free(key);
+      break;
+    }
+    key[entry.key_length] = '\0';
+    feed_record_t record = {entry.seq, entry.shard, entry.op, entry.val, entry.ttl_ms, key};
+    apply(&record, arg);
+    free(key);
+    n++;
+  }
+  fclose(file);
+  return n;
+}
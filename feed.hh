@@ -0,0 +1,104 @@
+#ifndef FEED_H
+#define FEED_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "lock.hh"
+
+#define FEED_SEG 256      // Records per log segment
+#define FEED_BATCH 4096   // Most records a subscriber takes, and syncs to disk, at once
+#define FEED_IDLE_US 100  // How long an idle subscriber sleeps before polling again
+#define FEED_MAX_KEY (1 << 20) // Longest key feed_replay accepts before treating a record as corrupt
+
+enum { FEED_SET, FEED_REMOVE };
+
+typedef struct feed_record {
+  unsigned long seq; // Position in its shard's log, from 1
+  int shard;
+  int op;            // FEED_SET or FEED_REMOVE
+  int val;
+  long ttl_ms;       // TTL the value was set with, 0 for none
+  char *key;
+} feed_record_t;
+
+typedef struct feed_segment {
+  feed_record_t records[FEED_SEG];
+  struct feed_segment *next;
+} feed_segment_t;
+
+// One shard's log: a single producer appends, a single consumer takes. Each side has its own
+// cache line, and the only shared word is appended.
+typedef struct feed_shard {
+  feed_segment_t *tail_seg; // Segment the producer appends to
+  unsigned long appended;   // Records published so far
+  int index;
+  feed_segment_t *head_seg __attribute__((aligned(CACHE_LINE))); // Segment the consumer reads
+  unsigned long consumed;   // Records taken so far
+  unsigned long batch_end;  // End of the batch being taken
+  unsigned long durable;    // Records synced to the log file (or, without one, applied) so far
+} __attribute__((aligned(CACHE_LINE))) feed_shard_t;
+
+typedef void (*feed_apply_t)(const feed_record_t* record, void* arg);
+
+typedef struct my_feed {
+  feed_shard_t *shards;
+  int nshards;
+  int fd;             // Log file in durable mode, -1 otherwise
+  char *buffer;       // Batch being written to the log file
+  long buffer_size;
+  pthread_t subscriber;
+  feed_apply_t apply; // Subscriber callback and its argument
+  void *arg;
+  bool stopping;      // Set to ask the subscriber to drain and exit
+  bool failed;        // Set once a batch could not be written to the log file
+  pthread_mutex_t durable_lock; // Wakes threads in feed_wait_durable after each batch
+  pthread_cond_t durable_cond;
+} my_feed_t;
+
+// Initialize a change feed with the given number of shards. If path is not NULL, records are
+// appended to that file, and synced, before a subscriber sees them. Returns false if the file
+// could not be opened.
+// Appending does not wait for the sync, so a dict_set with a feed attached returns before its
+// record is durable. Writers that need it to be call feed_wait_durable or feed_wait_appended
+// afterwards; every writer waiting on the same batch shares its one fdatasync.
+bool feed_init(my_feed_t* feed, int shards, const char* path);
+
+// Destroy a change feed, dropping any records that were never consumed
+void feed_destroy(my_feed_t* feed);
+
+// Copy a key for feed_append. Writers copy before taking the lock that serializes their appends,
+// so the allocation stays out of the critical section.
+char* feed_key(const char* key);
+
+// Append a record to a shard's log, taking ownership of key, which must come from malloc (see
+// feed_key). Returns its sequence number. Appends to one shard must not run concurrently; the
+// dictionary appends while holding the shard's bucket lock.
+unsigned long feed_append(feed_shard_t* shard, int op, char* key, int val, long ttl_ms);
+
+// Take up to max published records from every shard, passing each to apply in shard order.
+// In durable mode the whole batch is written and synced first. If the log file cannot be
+// written, the batch and every later one are dropped without being applied, and
+// feed_wait_durable reports the failure. Only one thread may consume at a time.
+// Returns the number of records taken.
+long feed_consume(my_feed_t* feed, feed_apply_t apply, void* arg, long max);
+
+// Start a subscriber thread that consumes the feed in batches, passing each record to apply
+void feed_subscribe(my_feed_t* feed, feed_apply_t apply, void* arg);
+
+// Wait until record seq of a shard has been synced to the log file, or, without one, applied.
+// Something must be consuming the feed. Returns false if the log file could not be written.
+bool feed_wait_durable(my_feed_t* feed, int shard, unsigned long seq);
+
+// Wait, as feed_wait_durable does, for every record appended to any shard before the call
+bool feed_wait_appended(my_feed_t* feed);
+
+// Stop the subscriber thread once it has consumed every record appended before the call
+void feed_unsubscribe(my_feed_t* feed);
+
+// Pass every record in a durable feed's log file to apply, in the order they were written.
+// Stops at a torn final record, or at one with an impossible key length.
+// Returns the number of records read, or -1 if the file could not be read.
+long feed_replay(const char* path, feed_apply_t apply, void* arg);
+
+#endif
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include "filter.hh"
+
+#define NUM_KEYS 10000
+
+/****** Filter Invariants ******/
+
+// Invariant 1
+// A key that has been added more times than it has been removed is always reported as maybe present.
+
+// Invariant 2
+// A key whose additions have all been removed is reported absent unless another key shares all of its counters.
+
+/****** Begin Tests ******/
+
+// A test of invariant 1: no false negatives, and a false positive rate near the design point
+TEST(FilterTest, Invariant1) {
+  filter_t f;
+  filter_init(&f, NUM_KEYS);
+  char key[16];
+  for(int i=0; i < NUM_KEYS; i++){
+    snprintf(key, sizeof(key), "in%d", i);
+    filter_add(&f, key);
+  }
+  for(int i=0; i < NUM_KEYS; i++){
+    snprintf(key, sizeof(key), "in%d", i);
+    ASSERT_TRUE(filter_maybe_contains(&f, key));
+  }
+  int false_positives = 0;
+  for(int i=0; i < NUM_KEYS; i++){
+    snprintf(key, sizeof(key), "out%d", i);
+    false_positives += filter_maybe_contains(&f, key);
+  }
+  ASSERT_LT(false_positives, NUM_KEYS / 20); // Designed for about 1%
+  filter_destroy(&f);
+}
+
+// A test of invariant 2: removal, including a key added twice
+TEST(FilterTest, Invariant2) {
+  filter_t f;
+  filter_init(&f, 100);
+  ASSERT_FALSE(filter_maybe_contains(&f, "A"));
+  filter_add(&f, "A");
+  filter_add(&f, "A");
+  filter_remove(&f, "A");
+  ASSERT_TRUE(filter_maybe_contains(&f, "A")); // One copy left
+  filter_remove(&f, "A");
+  ASSERT_FALSE(filter_maybe_contains(&f, "A"));
+  filter_destroy(&f);
+}
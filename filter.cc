@@ -0,0 +1,74 @@
+#include "filter.hh"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+// Filter implementation: a counting Bloom filter with one byte per counter. A key maps to
+// FILTER_HASHES counters derived from one 64-bit hash by double hashing (Kirsch and
+// Mitzenmacher). Adding increments them and removing decrements them, each with its own
+// atomic compare-and-swap, so there is no lock to contend on. A counter that reaches FILTER_MAX
+// is never decremented again: that can only cost false positives, never false negatives.
+
+// 64-bit FNV-1a with a final mix so both halves are usable as independent hashes
+static uint64_t filter_hash(const char* key){
+  uint64_t h = 14695981039346656037UL;
+  for(; *key != '\0'; key++){
+    h ^= (unsigned char) *key;
+    h *= 1099511628211UL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdUL;
+  h ^= h >> 33;
+  return h;
+}
+
+// Get the index of the ith counter for a hash
+static unsigned long filter_index(filter_t* filter, uint64_t h, int i){
+  uint32_t h1 = (uint32_t) h, h2 = (uint32_t) (h >> 32) | 1;
+  return (h1 + (uint64_t) i * h2) % filter->size;
+}
+
+// Initialize a filter sized for expected_keys keys
+void filter_init(filter_t* filter, long expected_keys) {
+  if(expected_keys < 1) expected_keys = 1;
+  filter->size = expected_keys * FILTER_BITS_PER_KEY;
+  filter->counters = (uint8_t*) calloc(filter->size, sizeof(uint8_t));
+  if(filter->counters == NULL) perror("Could not allocate space");
+}
+
+// Destroy a filter
+void filter_destroy(filter_t* filter) {
+  free(filter->counters);
+  filter->counters = NULL;
+}
+
+// Record one copy of key
+void filter_add(filter_t* filter, const char* key) {
+  uint64_t h = filter_hash(key);
+  for(int i=0; i<FILTER_HASHES; i++){
+    uint8_t *counter = &filter->counters[filter_index(filter, h, i)];
+    uint8_t old = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while(old < FILTER_MAX && !__atomic_compare_exchange_n(counter, &old, old + 1, true,
+                                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  }
+}
+
+// Forget one copy of key. Only call for keys that were added.
+void filter_remove(filter_t* filter, const char* key) {
+  uint64_t h = filter_hash(key);
+  for(int i=0; i<FILTER_HASHES; i++){
+    uint8_t *counter = &filter->counters[filter_index(filter, h, i)];
+    uint8_t old = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while(old > 0 && old < FILTER_MAX && !__atomic_compare_exchange_n(counter, &old, old - 1, true,
+                                                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  }
+}
+
+// Returns false only if key is definitely absent
+bool filter_maybe_contains(filter_t* filter, const char* key) {
+  uint64_t h = filter_hash(key);
+  for(int i=0; i<FILTER_HASHES; i++){
+    if(__atomic_load_n(&filter->counters[filter_index(filter, h, i)], __ATOMIC_ACQUIRE) == 0) return false;
+  }
+  return true;
+}
@@ -0,0 +1,32 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FILTER_HASHES 7 // Counters touched per key
+#define FILTER_BITS_PER_KEY 10 // Counters per expected key, about 1% false positives
+#define FILTER_MAX 255 // A counter that reaches this sticks there
+
+// Counting Bloom filter. Every operation is lock free.
+typedef struct filter {
+  uint8_t *counters;
+  unsigned long size; // Number of counters
+} filter_t;
+
+// Initialize a filter sized for expected_keys keys
+void filter_init(filter_t* filter, long expected_keys);
+
+// Destroy a filter
+void filter_destroy(filter_t* filter);
+
+// Record one copy of key
+void filter_add(filter_t* filter, const char* key);
+
+// Forget one copy of key. Only call for keys that were added.
+void filter_remove(filter_t* filter, const char* key);
+
+// Returns false only if key is definitely absent
+bool filter_maybe_contains(filter_t* filter, const char* key);
+
+#endif
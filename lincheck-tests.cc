@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include "lincheck.hh"
+
+#define SEED 213
+#define RING 256
+
+/****** Linearizability Invariants ******/
+
+// Invariant 1
+// lincheck_check accepts a history exactly when its operations can be ordered so that an
+// operation that returned before another was invoked comes first, and the sequential
+// specification accepts every operation in that order.
+
+// Invariant 2
+// lincheck_run reports a structure that breaks its specification, printing the history.
+// (The stack, queue and dictionary suites use it to check that they never do.)
+
+/****** Begin Tests ******/
+
+// Helper for tests: record an operation that ran from invoke to response
+void record(my_history_t* history, int thread, int kind, int key, int arg, int result,
+            unsigned long invoke, unsigned long response) {
+  lincheck_op_t *op = history_invoke(history, thread, kind, key, arg);
+  history_respond(history, op, result, true);
+  op->invoke = invoke;
+  op->response = response;
+}
+
+// A test of invariant 1 for stacks: overlapping pushes may take effect in either order
+TEST(LincheckTest, Invariant1Stack) {
+  my_history_t history;
+  lincheck_state_t empty;
+  empty.length = 0;
+  history_init(&history, 2, 8, 0, SEED);
+
+  record(&history, 0, LINCHECK_PUT, 0, 1, -1, 1, 2);
+  record(&history, 0, LINCHECK_PUT, 0, 2, -1, 3, 4);
+  record(&history, 1, LINCHECK_TAKE, 0, 0, 1, 5, 6); // 2 is on top
+  ASSERT_EQ(LINCHECK_FAILED, lincheck_check(&history, lincheck_stack_step, &empty));
+
+  history_clear(&history);
+  record(&history, 0, LINCHECK_PUT, 0, 1, -1, 1, 4);
+  record(&history, 1, LINCHECK_PUT, 0, 2, -1, 2, 3);
+  record(&history, 1, LINCHECK_TAKE, 0, 0, 1, 5, 6); // 1 may have gone on last
+  record(&history, 0, LINCHECK_TAKE, 0, 0, 2, 7, 8);
+  ASSERT_EQ(LINCHECK_OK, lincheck_check(&history, lincheck_stack_step, &empty));
+
+  history_clear(&history);
+  record(&history, 0, LINCHECK_PUT, 0, 1, -1, 1, 2);
+  record(&history, 1, LINCHECK_TAKE, 0, 0, -1, 3, 4); // Empty after a finished push
+  ASSERT_EQ(LINCHECK_FAILED, lincheck_check(&history, lincheck_stack_step, &empty));
+
+  history_clear(&history);
+  record(&history, 0, LINCHECK_PUT, 0, 1, -1, 1, 4);
+  record(&history, 1, LINCHECK_TAKE, 0, 0, -1, 2, 3); // Empty before an overlapping push
+  ASSERT_EQ(LINCHECK_OK, lincheck_check(&history, lincheck_stack_step, &empty));
+  history_destroy(&history);
+}
+
+// A test of invariant 1 for queues: elements leave in the order their puts took effect
+TEST(LincheckTest, Invariant1Queue) {
+  my_history_t history;
+  lincheck_state_t empty;
+  empty.length = 0;
+  history_init(&history, 2, 8, 0, SEED);
+
+  record(&history, 0, LINCHECK_PUT, 0, 1, -1, 1, 2);
+  record(&history, 0, LINCHECK_PUT, 0, 2, -1, 3, 4);
+  record(&history, 1, LINCHECK_TAKE, 0, 0, 2, 5, 6); // 1 is at the front
+  ASSERT_EQ(LINCHECK_FAILED, lincheck_check(&history, lincheck_queue_step, &empty));
+
+  history_clear(&history);
+  record(&history, 0, LINCHECK_PUT, 0, 1, -1, 1, 4);
+  record(&history, 1, LINCHECK_PUT, 0, 2, -1, 2, 3);
+  record(&history, 1, LINCHECK_TAKE, 0, 0, 2, 5, 6); // 2 may have gone in first
+  record(&history, 0, LINCHECK_TAKE, 0, 0, 1, 7, 8);
+  ASSERT_EQ(LINCHECK_OK, lincheck_check(&history, lincheck_queue_step, &empty));
+
+  history_clear(&history);
+  record(&history, 0, LINCHECK_PUT, 0, 1, -1, 1, 2);
+  record(&history, 0, LINCHECK_TAKE, 0, 0, 1, 3, 4);
+  record(&history, 1, LINCHECK_TAKE, 0, 0, 1, 5, 6); // Taken twice
+  ASSERT_EQ(LINCHECK_FAILED, lincheck_check(&history, lincheck_queue_step, &empty));
+
+  history_clear(&history);
+  record(&history, 0, LINCHECK_TAKE, 0, 0, 7, 1, 2); // Never put
+  ASSERT_EQ(LINCHECK_FAILED, lincheck_check(&history, lincheck_queue_step, &empty));
+  history_destroy(&history);
+}
+
+// A test of invariant 1 for dictionaries: reads see the last write that took effect
+TEST(LincheckTest, Invariant1Dict) {
+  my_history_t history;
+  lincheck_state_t empty;
+  empty.length = LINCHECK_KEYS;
+  for(int i=0; i < LINCHECK_KEYS; i++) empty.items[i] = -1;
+  history_init(&history, 2, 8, 0, SEED);
+
+  record(&history, 0, LINCHECK_SET, 3, 5, -1, 1, 2);
+  record(&history, 1, LINCHECK_GET, 3, 0, -1, 3, 4); // Stale read
+  ASSERT_EQ(LINCHECK_FAILED, lincheck_check(&history, lincheck_dict_step, &empty));
+
+  history_clear(&history);
+  record(&history, 0, LINCHECK_SET, 3, 5, -1, 1, 4);
+  record(&history, 1, LINCHECK_GET, 3, 0, -1, 2, 3); // Read before an overlapping set
+  record(&history, 1, LINCHECK_CONTAINS, 3, 0, 1, 5, 6);
+  record(&history, 1, LINCHECK_GET, 4, 0, -1, 7, 8); // Other keys are untouched
+  ASSERT_EQ(LINCHECK_OK, lincheck_check(&history, lincheck_dict_step, &empty));
+
+  history_clear(&history);
+  record(&history, 0, LINCHECK_SET, 3, 5, -1, 1, 2);
+  record(&history, 0, LINCHECK_REMOVE, 3, 0, -1, 3, 6);
+  record(&history, 1, LINCHECK_GET, 3, 0, -1, 4, 5);
+  record(&history, 1, LINCHECK_GET, 3, 0, 5, 7, 8); // Read after the remove returned
+  ASSERT_EQ(LINCHECK_FAILED, lincheck_check(&history, lincheck_dict_step, &empty));
+
+  // A try that gave up fits anywhere
+  history_clear(&history);
+  record(&history, 0, LINCHECK_SET, 3, 5, -1, 1, 2);
+  lincheck_op_t *op = history_invoke(&history, 1, LINCHECK_GET, 3, 0);
+  history_respond(&history, op, -1, false);
+  ASSERT_EQ(LINCHECK_OK, lincheck_check(&history, lincheck_dict_step, &empty));
+  history_destroy(&history);
+}
+
+typedef struct ring {
+  int items[RING];
+  long first, last;
+  pthread_mutex_t lock;
+} ring_t;
+
+// Round for tests: pushes and pops on a "stack" that is really a FIFO ring
+void ring_round(my_history_t* history, void* target, int thread, int first, int ops) {
+  ring_t *ring = (ring_t*) target;
+  for(int i=0; i < ops; i++) {
+    bool put = history_random(history, thread) % 2 == 0;
+    lincheck_op_t *op = history_invoke(history, thread, put ? LINCHECK_PUT : LINCHECK_TAKE, 0, put ? first + i : 0);
+    int result = -1;
+    pthread_mutex_lock(&ring->lock);
+    if(put) ring->items[ring->last++ % RING] = first + i;
+    else if(ring->first < ring->last) result = ring->items[ring->first++ % RING];
+    pthread_mutex_unlock(&ring->lock);
+    history_respond(history, op, result, true);
+  }
+}
+
+// Drain for tests: take from the ring until it is empty
+void ring_drain(my_history_t* history, void* target, int thread, int first, int ops) {
+  ring_t *ring = (ring_t*) target;
+  int result;
+  do {
+    lincheck_op_t *op = history_invoke(history, thread, LINCHECK_TAKE, 0, 0);
+    result = ring->first < ring->last ? ring->items[ring->first++ % RING] : -1;
+    history_respond(history, op, result, true);
+  } while(result != -1);
+}
+
+// A test of invariant 2: a FIFO passes as a queue and is caught posing as a stack
+TEST(LincheckTest, Invariant2) {
+  lincheck_state_t empty;
+  empty.length = 0;
+  ring_t ring;
+  ring.first = ring.last = 0;
+  pthread_mutex_init(&ring.lock, NULL);
+  ASSERT_EQ(0, lincheck_run(&ring, ring_round, ring_drain, lincheck_queue_step, &empty,
+                            LINCHECK_THREADS, LINCHECK_OPS, 200, LINCHECK_PERTURB, SEED));
+  ASSERT_EQ(1, lincheck_run(&ring, ring_round, ring_drain, lincheck_stack_step, &empty,
+                            LINCHECK_THREADS, LINCHECK_OPS, 200, LINCHECK_PERTURB, SEED));
+  pthread_mutex_destroy(&ring.lock);
+}
@@ -0,0 +1,524 @@
+#include "lincheck.hh"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+
+// Linearizability checker implementation (Wing & Gong's search with Lowe's memoization).
+// The history becomes one list of call and return events in time order. The search walks the
+// list: at a call whose operation step accepts from the current state, it linearizes that
+// operation, lifting its call and return out of the list, and starts again from the front.
+// Reaching a return means the operation it belongs to was not linearized before it returned,
+// so the search backtracks to the last choice. Each (set of linearized operations, state)
+// pair is explored once: pairs already seen are skipped, which keeps the search close to
+// linear for histories with a few threads. Queues and stacks with many overlapping puts can
+// still have too many orders to explore, so a search stops after LINCHECK_MAX_SEEN pairs.
+
+typedef struct lincheck_entry {
+  int op;       // Index of the operation
+  bool call;    // Call or return event
+  unsigned long time;
+  struct lincheck_entry *prev, *next;
+  struct lincheck_entry *match; // The other event of the same operation
+} lincheck_entry_t;
+
+// A configuration already explored
+typedef struct lincheck_seen {
+  struct lincheck_seen *next;
+  unsigned long hash;
+  unsigned long bits[LINCHECK_WORDS];
+  int length;
+  int *items;
+} lincheck_seen_t;
+
+typedef struct lincheck_cache {
+  lincheck_seen_t **buckets;
+  long nbuckets, count;
+} lincheck_cache_t;
+
+// Point in the search to backtrack to
+typedef struct lincheck_frame {
+  lincheck_entry_t *entry;
+  lincheck_state_t state;
+} lincheck_frame_t;
+
+static const char* kind_names[] = {"put", "take", "set", "get", "remove", "contains"};
+
+// Initialize a history with one log of capacity operations for each of threads threads.
+// Calls are delayed at random with probability perturb/1024; seed makes runs repeatable.
+void history_init(my_history_t* history, int threads, int capacity, int perturb, unsigned int seed) {
+  history->logs = (history_log_t*) aligned_alloc(CACHE_LINE, sizeof(history_log_t) * threads);
+  assert(history->logs != NULL);
+  for(int i=0; i<threads; i++){
+    history->logs[i].ops = (lincheck_op_t*) malloc(sizeof(lincheck_op_t) * capacity);
+    assert(history->logs[i].ops != NULL);
+    history->logs[i].length = 0;
+    history->logs[i].seed = 2654435761u * (seed + i) | 1; // xorshift state must not be 0
+  }
+  history->nlogs = threads;
+  history->capacity = capacity;
+  history->perturb = perturb;
+  history->clock = 0;
+}
+
+// Destroy a history
+void history_destroy(my_history_t* history) {
+  for(int i=0; i<history->nlogs; i++){
+    free(history->logs[i].ops);
+  }
+  free(history->logs);
+}
+
+// Forget every recorded operation, keeping the clock running
+void history_clear(my_history_t* history) {
+  for(int i=0; i<history->nlogs; i++){
+    history->logs[i].length = 0;
+  }
+}
+
+// Get the number of operations recorded (exact once threads are quiescent)
+int history_length(my_history_t* history) {
+  int n = 0;
+  for(int i=0; i<history->nlogs; i++){
+    n += history->logs[i].length;
+  }
+  return n;
+}
+
+// Draw a random number from a thread's log, for choosing operations repeatably
+unsigned int history_random(my_history_t* history, int thread) {
+  history_log_t *log = &history->logs[thread];
+  log->seed ^= log->seed << 13;
+  log->seed ^= log->seed >> 17;
+  log->seed ^= log->seed << 5;
+  return log->seed;
+}
+
+// lincheck_delay delays the calling thread with probability perturb/1024, by yielding the CPU
+// or by spinning for a random while, so that runs explore interleavings the scheduler would
+// rarely produce. r is a fresh random number.
+static void lincheck_delay(unsigned int r, int perturb){
+  if((int) (r & 1023) >= perturb) return;
+  if(r & 1024){
+    sched_yield();
+  } else {
+    for(unsigned int spins = (r >> 11) % 2048; spins > 0; spins--){
+      __atomic_signal_fence(__ATOMIC_SEQ_CST); // Keep the loop from being optimized away
+    }
+  }
+}
+
+// history_perturb sometimes delays a thread before it starts an operation
+static void history_perturb(my_history_t* history, int thread){
+  lincheck_delay(history_random(history, thread), history->perturb);
+}
+
+#ifdef SCHED_POINTS
+int sched_perturb = 0;
+static int sched_threads = 0; // Threads that have reached a schedule point, for seeding
+static __thread unsigned int sched_seed = 0;
+
+// Delay the calling thread at random inside an operation (see SCHED_POINT in lock.hh)
+void sched_point() {
+  int perturb = __atomic_load_n(&sched_perturb, __ATOMIC_RELAXED);
+  if(perturb == 0) return;
+  if(sched_seed == 0) sched_seed = 2654435761u * __atomic_add_fetch(&sched_threads, 1, __ATOMIC_RELAXED) | 1;
+  sched_seed ^= sched_seed << 13;
+  sched_seed ^= sched_seed >> 17;
+  sched_seed ^= sched_seed << 5;
+  lincheck_delay(sched_seed, perturb);
+}
+#endif
+
+// Record the start of an operation by thread, just before it is called. May delay the caller.
+// Returns the record to pass to history_respond.
+lincheck_op_t* history_invoke(my_history_t* history, int thread, int kind, int key, int arg) {
+  history_perturb(history, thread); // Before the stamp, so it does not widen the operation
+  history_log_t *log = &history->logs[thread];
+  assert(log->length < history->capacity);
+  lincheck_op_t *op = &log->ops[log->length++];
+  op->thread = thread;
+  op->kind = kind;
+  op->key = key;
+  op->arg = arg;
+  op->result = -1;
+  op->ok = true;
+  op->invoke = __atomic_add_fetch(&history->clock, 1, __ATOMIC_SEQ_CST);
+  return op;
+}
+
+// Record the return of an operation, just after the call
+void history_respond(my_history_t* history, lincheck_op_t* op, int result, bool ok) {
+  op->result = result;
+  op->ok = ok;
+  op->response = __atomic_add_fetch(&history->clock, 1, __ATOMIC_SEQ_CST);
+}
+
+// history_ops collects pointers to every recorded operation. Returns how many there are.
+static int history_ops(my_history_t* history, lincheck_op_t** ops){
+  int n = 0;
+  for(int i=0; i<history->nlogs; i++){
+    for(int j=0; j<history->logs[i].length; j++){
+      ops[n++] = &history->logs[i].ops[j];
+    }
+  }
+  return n;
+}
+
+// compare_invoke orders operations by invocation time, for qsort
+static int compare_invoke(const void* a, const void* b){
+  const lincheck_op_t *x = *(lincheck_op_t* const*) a, *y = *(lincheck_op_t* const*) b;
+  return x->invoke < y->invoke ? -1 : x->invoke > y->invoke;
+}
+
+// Print a history, ordered by invocation, for reproducing a failure
+void history_dump(my_history_t* history, FILE* file) {
+  int length = history_length(history);
+  lincheck_op_t **ops = (lincheck_op_t**) malloc(sizeof(lincheck_op_t*) * (length + 1));
+  assert(ops != NULL);
+  int n = history_ops(history, ops);
+  qsort(ops, n, sizeof(lincheck_op_t*), compare_invoke);
+  for(int i=0; i<n; i++){
+    lincheck_op_t *op = ops[i];
+    fprintf(file, "[%lu, %lu] thread %d %s(key %d, arg %d) -> %d%s\n", op->invoke, op->response,
+            op->thread, kind_names[op->kind], op->key, op->arg, op->result, op->ok ? "" : " (gave up)");
+  }
+  free(ops);
+}
+
+// compare_time orders events by time, for qsort
+static int compare_time(const void* a, const void* b){
+  const lincheck_entry_t *x = *(lincheck_entry_t* const*) a, *y = *(lincheck_entry_t* const*) b;
+  return x->time < y->time ? -1 : x->time > y->time;
+}
+
+// lincheck_lift takes an operation's call and return out of the event list
+static void lincheck_lift(lincheck_entry_t* call){
+  call->prev->next = call->next;
+  call->next->prev = call->prev; // The return always follows the call
+  lincheck_entry_t *ret = call->match;
+  ret->prev->next = ret->next;
+  if(ret->next != NULL) ret->next->prev = ret->prev;
+}
+
+// lincheck_unlift puts back an operation lifted by lincheck_lift
+static void lincheck_unlift(lincheck_entry_t* call){
+  lincheck_entry_t *ret = call->match;
+  ret->prev->next = ret;
+  if(ret->next != NULL) ret->next->prev = ret;
+  call->prev->next = call;
+  call->next->prev = call;
+}
+
+// state_copy copies the live part of a state
+static void state_copy(lincheck_state_t* dst, const lincheck_state_t* src){
+  dst->length = src->length;
+  memcpy(dst->items, src->items, sizeof(int) * src->length);
+}
+
+// lincheck_hash hashes a configuration (FNV-1a over its words)
+static unsigned long lincheck_hash(const unsigned long* bits, const lincheck_state_t* state){
+  unsigned long hash = 14695981039346656037ul;
+  for(int i=0; i<LINCHECK_WORDS; i++){
+    hash = (hash ^ bits[i]) * 1099511628211ul;
+  }
+  for(int i=0; i<state->length; i++){
+    hash = (hash ^ (unsigned int) state->items[i]) * 1099511628211ul;
+  }
+  return hash;
+}
+
+// lincheck_remember adds a configuration to the cache.
+// Returns false if it was already there.
+static bool lincheck_remember(lincheck_cache_t* cache, const unsigned long* bits, const lincheck_state_t* state){
+  unsigned long hash = lincheck_hash(bits, state);
+  for(lincheck_seen_t *seen = cache->buckets[hash % cache->nbuckets]; seen != NULL; seen = seen->next){
+    if(seen->hash == hash && seen->length == state->length &&
+       memcmp(seen->bits, bits, sizeof(seen->bits)) == 0 &&
+       memcmp(seen->items, state->items, sizeof(int) * state->length) == 0) return false;
+  }
+  if(cache->count >= cache->nbuckets){ // Double the table to keep chains short
+    long nbuckets = cache->nbuckets * 2;
+    lincheck_seen_t **buckets = (lincheck_seen_t**) calloc(nbuckets, sizeof(lincheck_seen_t*));
+    assert(buckets != NULL);
+    for(long i=0; i<cache->nbuckets; i++){
+      for(lincheck_seen_t *seen = cache->buckets[i], *next; seen != NULL; seen = next){
+        next = seen->next;
+        seen->next = buckets[seen->hash % nbuckets];
+        buckets[seen->hash % nbuckets] = seen;
+      }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->nbuckets = nbuckets;
+  }
+  lincheck_seen_t *seen = (lincheck_seen_t*) malloc(sizeof(lincheck_seen_t) + sizeof(int) * state->length);
+  assert(seen != NULL);
+  seen->hash = hash;
+  memcpy(seen->bits, bits, sizeof(seen->bits));
+  seen->length = state->length;
+  seen->items = (int*) (seen + 1);
+  memcpy(seen->items, state->items, sizeof(int) * state->length);
+  seen->next = cache->buckets[hash % cache->nbuckets];
+  cache->buckets[hash % cache->nbuckets] = seen;
+  cache->count++;
+  return true;
+}
+
+// Check that a history is linearizable: that its operations can be ordered, each one taking
+// effect at some point between its invoke and response, so that step accepts every one of
+// them starting from initial. Threads must be quiescent. Returns LINCHECK_OK if it is,
+// LINCHECK_FAILED if not, or LINCHECK_UNDECIDED if the search gave up after exploring
+// LINCHECK_MAX_SEEN configurations (queues and stacks with many overlapping puts).
+int lincheck_check(my_history_t* history, lincheck_step_t step, const lincheck_state_t* initial) {
+  int length = history_length(history);
+  assert(length <= LINCHECK_MAX_OPS);
+  lincheck_op_t *ops[LINCHECK_MAX_OPS];
+  int n = 0;
+  for(int i=0, all = history_ops(history, ops); i<all; i++){
+    if(ops[i]->ok) ops[n++] = ops[i]; // A try that gave up had no effect, so it fits anywhere
+  }
+
+  // Build the event list in time order, behind a sentinel
+  lincheck_entry_t *entries = (lincheck_entry_t*) malloc(sizeof(lincheck_entry_t) * (2 * n + 1));
+  lincheck_entry_t **order = (lincheck_entry_t**) malloc(sizeof(lincheck_entry_t*) * (2 * n + 1));
+  assert(entries != NULL && order != NULL);
+  for(int i=0; i<n; i++){
+    lincheck_entry_t *call = &entries[2 * i], *ret = &entries[2 * i + 1];
+    call->op = ret->op = i;
+    call->call = true;
+    ret->call = false;
+    call->time = ops[i]->invoke;
+    ret->time = ops[i]->response;
+    call->match = ret;
+    ret->match = call;
+    order[2 * i] = call;
+    order[2 * i + 1] = ret;
+  }
+  qsort(order, 2 * n, sizeof(lincheck_entry_t*), compare_time);
+  lincheck_entry_t *head = &entries[2 * n];
+  head->prev = NULL;
+  lincheck_entry_t *last = head;
+  for(int i=0; i<2 * n; i++){
+    last->next = order[i];
+    order[i]->prev = last;
+    last = order[i];
+  }
+  last->next = NULL;
+  free(order);
+
+  lincheck_cache_t cache;
+  cache.nbuckets = 1024;
+  cache.count = 0;
+  cache.buckets = (lincheck_seen_t**) calloc(cache.nbuckets, sizeof(lincheck_seen_t*));
+  lincheck_frame_t *frames = (lincheck_frame_t*) malloc(sizeof(lincheck_frame_t) * (n + 1));
+  lincheck_state_t *state = (lincheck_state_t*) malloc(sizeof(lincheck_state_t) * 2);
+  assert(cache.buckets != NULL && frames != NULL && state != NULL);
+  lincheck_state_t *next = state + 1;
+  state_copy(state, initial);
+  unsigned long bits[LINCHECK_WORDS] = {0};
+  int depth = 0;
+  int result = LINCHECK_OK;
+
+  lincheck_entry_t *entry = head->next;
+  while(head->next != NULL){
+    if(entry->call){
+      if(step(state, ops[entry->op], next)){
+        bits[entry->op / 64] |= 1ul << (entry->op % 64);
+        if(lincheck_remember(&cache, bits, next)){
+          if(cache.count > LINCHECK_MAX_SEEN){
+            result = LINCHECK_UNDECIDED;
+            break;
+          }
+          frames[depth].entry = entry;
+          state_copy(&frames[depth].state, state);
+          depth++;
+          lincheck_state_t *swap = state;
+          state = next;
+          next = swap;
+          lincheck_lift(entry);
+          entry = head->next;
+          continue;
+        }
+        bits[entry->op / 64] &= ~(1ul << (entry->op % 64));
+      }
+      entry = entry->next;
+    } else { // An operation returned without being linearized: undo the last choice
+      if(depth == 0){
+        result = LINCHECK_FAILED;
+        break;
+      }
+      depth--;
+      entry = frames[depth].entry;
+      state_copy(state, &frames[depth].state);
+      bits[entry->op / 64] &= ~(1ul << (entry->op % 64));
+      lincheck_unlift(entry);
+      entry = entry->next;
+    }
+  }
+
+  // Clean up
+  for(long i=0; i<cache.nbuckets; i++){
+    for(lincheck_seen_t *seen = cache.buckets[i], *next_seen; seen != NULL; seen = next_seen){
+      next_seen = seen->next;
+      free(seen);
+    }
+  }
+  free(cache.buckets);
+  free(frames);
+  free(state < next ? state : next);
+  free(entries);
+  return result;
+}
+
+// Threads and rounds shared by lincheck_run and its workers
+typedef struct lincheck_harness {
+  my_history_t history;
+  pthread_barrier_t start, done;
+  void *target;
+  lincheck_round_t run;
+  int threads, ops, round;
+  bool stop;
+} lincheck_harness_t;
+
+typedef struct lincheck_worker_args {
+  lincheck_harness_t *h;
+  int thread;
+} lincheck_worker_args_t;
+
+// lincheck_first gives the first element unique to one thread's share of a round
+static int lincheck_first(lincheck_harness_t* h, int thread){
+  return (h->round * (h->threads + 1) + thread) * h->ops;
+}
+
+// Worker thread: run a share of each round the main thread starts, until told to stop
+static void* lincheck_worker(void* arg){
+  lincheck_worker_args_t *args = (lincheck_worker_args_t*) arg;
+  lincheck_harness_t *h = args->h;
+  for(;;){
+    pthread_barrier_wait(&h->start);
+    if(h->stop) break;
+    h->run(&h->history, h->target, args->thread, lincheck_first(h, args->thread), h->ops);
+    pthread_barrier_wait(&h->done);
+  }
+  return NULL;
+}
+
+// Run rounds rounds of run, with ops operations on each of threads threads, against target.
+// After each round drain runs alone, as thread threads, and must leave target as it was at
+// the start; then the round's history is checked against step from initial. Threads are
+// delayed with probability perturb/1024 before each operation and, in builds with
+// SCHED_POINTS, at each schedule point inside one. The first history that is not linearizable
+// is printed to stderr and ends the run; rounds too large to decide are counted on stderr.
+// Returns the number of rounds that were not linearizable, 0 or 1.
+int lincheck_run(void* target, lincheck_round_t run, lincheck_round_t drain, lincheck_step_t step,
+                 const lincheck_state_t* initial, int threads, int ops, int rounds, int perturb, unsigned int seed) {
+  // The drain can take back every element put in the round, and then find the target empty
+  assert(2 * threads * ops + LINCHECK_KEYS <= LINCHECK_MAX_OPS);
+  lincheck_harness_t h;
+  history_init(&h.history, threads + 1, threads * ops + LINCHECK_KEYS, perturb, seed);
+  pthread_barrier_init(&h.start, NULL, threads + 1);
+  pthread_barrier_init(&h.done, NULL, threads + 1);
+  h.target = target;
+  h.run = run;
+  h.threads = threads;
+  h.ops = ops;
+  h.stop = false;
+
+  pthread_t *workers = (pthread_t*) malloc(sizeof(pthread_t) * threads);
+  lincheck_worker_args_t *args = (lincheck_worker_args_t*) malloc(sizeof(lincheck_worker_args_t) * threads);
+  assert(workers != NULL && args != NULL);
+  for(int i=0; i<threads; i++){
+    args[i].h = &h;
+    args[i].thread = i;
+    if(pthread_create(&workers[i], NULL, lincheck_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+
+#ifdef SCHED_POINTS
+  __atomic_store_n(&sched_perturb, perturb, __ATOMIC_RELAXED);
+#endif
+  int failures = 0, undecided = 0, r;
+  for(r=0; r<rounds && failures == 0; r++){
+    history_clear(&h.history);
+    h.round = r;
+    pthread_barrier_wait(&h.start); // The barriers order the round's records before the check
+    pthread_barrier_wait(&h.done);
+    drain(&h.history, target, threads, lincheck_first(&h, threads), ops);
+    int result = lincheck_check(&h.history, step, initial);
+    if(result == LINCHECK_UNDECIDED) undecided++;
+    if(result == LINCHECK_FAILED){
+      fprintf(stderr, "Round %d (seed %u) is not linearizable:\n", r, seed);
+      history_dump(&h.history, stderr);
+      failures++;
+    }
+  }
+  if(undecided > 0) fprintf(stderr, "%d of %d rounds were too large to check\n", undecided, r);
+
+  // Clean up
+#ifdef SCHED_POINTS
+  __atomic_store_n(&sched_perturb, 0, __ATOMIC_RELAXED);
+#endif
+  h.stop = true;
+  pthread_barrier_wait(&h.start);
+  for(int i=0; i<threads; i++){
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+  free(workers);
+  free(args);
+  pthread_barrier_destroy(&h.start);
+  pthread_barrier_destroy(&h.done);
+  history_destroy(&h.history);
+  return failures;
+}
+
+// Sequential specification of a stack (LIFO); TAKE returns -1 only when empty
+bool lincheck_stack_step(const lincheck_state_t* state, const lincheck_op_t* op, lincheck_state_t* next) {
+  if(op->kind == LINCHECK_PUT){
+    if(state->length == LINCHECK_MAX_OPS) return false;
+    state_copy(next, state);
+    next->items[next->length++] = op->arg;
+    return true;
+  }
+  assert(op->kind == LINCHECK_TAKE);
+  if(op->result == -1){
+    next->length = 0;
+    return state->length == 0;
+  }
+  if(state->length == 0 || state->items[state->length - 1] != op->result) return false;
+  next->length = state->length - 1; // Check before copying: most steps tried are rejected
+  memcpy(next->items, state->items, sizeof(int) * next->length);
+  return true;
+}
+
+// Sequential specification of a queue (FIFO); TAKE returns -1 only when empty
+bool lincheck_queue_step(const lincheck_state_t* state, const lincheck_op_t* op, lincheck_state_t* next) {
+  if(op->kind == LINCHECK_PUT){
+    state_copy(next, state);
+    if(state->length == LINCHECK_MAX_OPS) return false;
+    next->items[next->length++] = op->arg;
+    return true;
+  }
+  assert(op->kind == LINCHECK_TAKE);
+  if(op->result == -1){
+    next->length = 0;
+    return state->length == 0;
+  }
+  if(state->length == 0 || state->items[0] != op->result) return false;
+  next->length = state->length - 1;
+  memcpy(next->items, state->items + 1, sizeof(int) * next->length);
+  return true;
+}
+
+// Sequential specification of a dictionary over LINCHECK_KEYS keys with non-negative values
+bool lincheck_dict_step(const lincheck_state_t* state, const lincheck_op_t* op, lincheck_state_t* next) {
+  assert(op->key >= 0 && op->key < state->length);
+  int current = state->items[op->key];
+  if(op->kind == LINCHECK_GET && op->result != current) return false;
+  if(op->kind == LINCHECK_CONTAINS && op->result != (current != -1)) return false;
+  state_copy(next, state);
+  if(op->kind == LINCHECK_SET) next->items[op->key] = op->arg;
+  else if(op->kind == LINCHECK_REMOVE) next->items[op->key] = -1;
+  return true;
+}
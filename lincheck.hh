@@ -0,0 +1,127 @@
+#ifndef LINCHECK_H
+#define LINCHECK_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "lock.hh"
+
+#define LINCHECK_MAX_OPS 256 // Most operations one history can hold and still be checked
+#define LINCHECK_WORDS (LINCHECK_MAX_OPS / 64)
+#define LINCHECK_KEYS 8      // Keys a dictionary history may use, 0 to LINCHECK_KEYS - 1
+#define LINCHECK_MAX_SEEN (1 << 19) // Configurations one check explores before giving up
+
+// Size of the stress tests; make stress raises these with -D
+#ifndef LINCHECK_THREADS
+#define LINCHECK_THREADS 4
+#endif
+#ifndef LINCHECK_OPS
+#define LINCHECK_OPS 8       // Operations each thread runs in a round
+#endif
+#ifndef LINCHECK_ROUNDS
+#define LINCHECK_ROUNDS 4000
+#endif
+#ifndef LINCHECK_PERTURB
+#define LINCHECK_PERTURB 64  // Chance out of 1024 that an operation is delayed
+#endif
+
+// Operation kinds. Stacks and queues use PUT and TAKE; dictionaries use the rest.
+enum { LINCHECK_PUT, LINCHECK_TAKE, LINCHECK_SET, LINCHECK_GET, LINCHECK_REMOVE, LINCHECK_CONTAINS };
+
+// Outcomes of a check
+enum { LINCHECK_OK, LINCHECK_FAILED, LINCHECK_UNDECIDED };
+
+typedef struct lincheck_op {
+  int thread;
+  int kind;
+  int key;                // Dictionary key index
+  int arg;                // Element put or value set
+  int result;             // Element taken or value read, -1 for none
+  bool ok;                // False if a try operation gave up without taking effect
+  unsigned long invoke;   // Logical times the call started and returned
+  unsigned long response;
+} lincheck_op_t;
+
+// One thread's operations, on lines of their own
+typedef struct history_log {
+  lincheck_op_t *ops;
+  int length;
+  unsigned int seed; // Random state for this thread's perturbation and test choices
+} __attribute__((aligned(CACHE_LINE))) history_log_t;
+
+typedef struct my_history {
+  history_log_t *logs;
+  int nlogs;
+  int capacity;        // Operations each log can hold
+  int perturb;         // Chance out of 1024 that a thread is delayed before an operation
+  unsigned long clock; // Logical time; every invoke and response takes the next tick
+} my_history_t;
+
+// Abstract state of the structure under test: a stack or queue's elements, bottom or front
+// first, or a dictionary's value for each key (-1 if absent)
+typedef struct lincheck_state {
+  int length;
+  int items[LINCHECK_MAX_OPS];
+} lincheck_state_t;
+
+// Sequential specification: apply op to state, storing the result in next. Returns false if
+// op could not have returned what it did from state.
+typedef bool (*lincheck_step_t)(const lincheck_state_t* state, const lincheck_op_t* op, lincheck_state_t* next);
+
+// Runs one thread's share of a round against target, recording each operation in history.
+// Elements first to first + ops - 1 are unique to this call.
+typedef void (*lincheck_round_t)(my_history_t* history, void* target, int thread, int first, int ops);
+
+// Initialize a history with one log of capacity operations for each of threads threads.
+// Calls are delayed at random with probability perturb/1024; seed makes runs repeatable.
+void history_init(my_history_t* history, int threads, int capacity, int perturb, unsigned int seed);
+
+// Destroy a history
+void history_destroy(my_history_t* history);
+
+// Forget every recorded operation, keeping the clock running
+void history_clear(my_history_t* history);
+
+// Get the number of operations recorded (exact once threads are quiescent)
+int history_length(my_history_t* history);
+
+// Draw a random number from a thread's log, for choosing operations repeatably
+unsigned int history_random(my_history_t* history, int thread);
+
+// Record the start of an operation by thread, just before it is called. May delay the caller.
+// Returns the record to pass to history_respond.
+lincheck_op_t* history_invoke(my_history_t* history, int thread, int kind, int key, int arg);
+
+// Record the return of an operation, just after the call
+void history_respond(my_history_t* history, lincheck_op_t* op, int result, bool ok);
+
+// Print a history, ordered by invocation, for reproducing a failure
+void history_dump(my_history_t* history, FILE* file);
+
+// Check that a history is linearizable: that its operations can be ordered, each one taking
+// effect at some point between its invoke and response, so that step accepts every one of
+// them starting from initial. Threads must be quiescent. Returns LINCHECK_OK if it is,
+// LINCHECK_FAILED if not, or LINCHECK_UNDECIDED if the search gave up after exploring
+// LINCHECK_MAX_SEEN configurations (queues and stacks with many overlapping puts).
+int lincheck_check(my_history_t* history, lincheck_step_t step, const lincheck_state_t* initial);
+
+// Run rounds rounds of run, with ops operations on each of threads threads, against target.
+// After each round drain runs alone, as thread threads, and must leave target as it was at
+// the start; then the round's history is checked against step from initial. Threads are
+// delayed with probability perturb/1024 before each operation and, in builds with
+// SCHED_POINTS, at each schedule point inside one. The first history that is not linearizable
+// is printed to stderr and ends the run; rounds too large to decide are counted on stderr.
+// Returns the number of rounds that were not linearizable, 0 or 1.
+int lincheck_run(void* target, lincheck_round_t run, lincheck_round_t drain, lincheck_step_t step,
+                 const lincheck_state_t* initial, int threads, int ops, int rounds, int perturb, unsigned int seed);
+
+// Sequential specification of a stack (LIFO); TAKE returns -1 only when empty
+bool lincheck_stack_step(const lincheck_state_t* state, const lincheck_op_t* op, lincheck_state_t* next);
+
+// Sequential specification of a queue (FIFO); TAKE returns -1 only when empty
+bool lincheck_queue_step(const lincheck_state_t* state, const lincheck_op_t* op, lincheck_state_t* next);
+
+// Sequential specification of a dictionary over LINCHECK_KEYS keys with non-negative values
+bool lincheck_dict_step(const lincheck_state_t* state, const lincheck_op_t* op, lincheck_state_t* next);
+
+#endif
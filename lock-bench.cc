@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include "stack.hh"
+
+#define NUM_THREADS 8
+#define OPS_PER_THREAD 1000000
+
+// Benchmark: NUM_THREADS threads push and pop on one shared stack, so every operation fights
+// over stack->lock. Reports throughput and the context switches the process took, which is
+// where the adaptive lock should differ from a plain pthread mutex (build with -DPTHREAD_LOCKS).
+// Pass "combining" to run the same loop against a flat-combining stack.
+
+my_stack_t s;
+
+// Worker thread: alternate push and pop
+void* bench_worker(void* arg){
+  for(int i=0; i < OPS_PER_THREAD; i++){
+    stack_push(&s, i);
+    stack_pop(&s);
+  }
+  pthread_exit(0);
+}
+
+int main(int argc, char** argv){
+  bool combining = argc > 1 && strcmp(argv[1], "combining") == 0;
+  if(combining){
+    stack_init_combining(&s);
+  } else {
+    stack_init(&s);
+  }
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+
+  pthread_t workers[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++){
+    if(pthread_create(&workers[i], NULL, bench_worker, NULL) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++){ // Wait for threads to exit
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  gettimeofday(&end, NULL);
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+#ifdef PTHREAD_LOCKS
+  const char *mode = "pthread";
+#else
+  const char *mode = "adaptive";
+#endif
+  printf("%-9s%-10s %d threads: %.0f ops/sec, %ld voluntary / %ld involuntary context switches\n",
+         mode, combining ? "+combining" : "", NUM_THREADS, 2.0 * NUM_THREADS * OPS_PER_THREAD / secs,
+         usage.ru_nvcsw, usage.ru_nivcsw);
+  stack_destroy(&s);
+  return 0;
+}
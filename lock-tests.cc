@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include "lock.hh"
+
+#define NUM_THREADS 16
+#define INCREMENTS 10000
+
+/****** Lock Invariants ******/
+
+// Invariant 1
+// At most one thread holds a lock at a time, so increments made under the lock are never lost.
+
+// Invariant 2
+// lock_try_acquire never waits: it fails while the lock is held and succeeds once it is released.
+
+/****** Begin Tests ******/
+
+typedef struct inc_args {
+  my_lock_t *l;
+  int *count;
+} inc_args_t;
+
+// Worker thread for invariant 1 test
+void* inc_worker(void* arg){
+  inc_args_t *args = (inc_args_t*) arg;
+  for(int i=0; i < INCREMENTS; i++){
+    lock_acquire(args->l);
+    (*args->count)++;
+    lock_release(args->l);
+  }
+  pthread_exit(0);
+}
+
+// A test of invariant 1: mutual exclusion
+TEST(LockTest, Invariant1){
+  my_lock_t l;
+  lock_init(&l);
+  int count = 0;
+
+  inc_args_t args = {&l, &count};
+  pthread_t workers[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++){
+    if(pthread_create(&workers[i], NULL, inc_worker, &args) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++){ // Wait for threads to exit
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  ASSERT_EQ(NUM_THREADS * INCREMENTS, count);
+  lock_destroy(&l);
+}
+
+// Worker thread for invariant 2 test: report whether try_acquire succeeded
+void* try_worker(void* arg){
+  my_lock_t *l = (my_lock_t*) arg;
+  bool acquired = lock_try_acquire(l);
+  if(acquired) lock_release(l);
+  return (void*) acquired;
+}
+
+// A test of invariant 2: try_acquire fails fast on a held lock
+TEST(LockTest, Invariant2){
+  my_lock_t l;
+  lock_init(&l);
+  pthread_t worker;
+  void *acquired;
+
+  lock_acquire(&l);
+  if(pthread_create(&worker, NULL, try_worker, &l) != 0) perror("Could not create thread");
+  if(pthread_join(worker, &acquired) != 0) perror("Could not exit thread");
+  ASSERT_FALSE((bool) acquired); // Held by us, so the other thread must give up
+
+  lock_release(&l);
+  if(pthread_create(&worker, NULL, try_worker, &l) != 0) perror("Could not create thread");
+  if(pthread_join(worker, &acquired) != 0) perror("Could not exit thread");
+  ASSERT_TRUE((bool) acquired);
+  lock_destroy(&l);
+}
@@ -0,0 +1,106 @@
+#include "lock.hh"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#ifndef PTHREAD_LOCKS
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef PTHREAD_LOCKS
+
+// Initialize a lock
+void lock_init(my_lock_t* lock) {
+  if(pthread_mutex_init(&lock->mutex, NULL) != 0) perror("Could not initialize mutex lock");
+}
+
+// Destroy a lock
+void lock_destroy(my_lock_t* lock) {
+  pthread_mutex_destroy(&lock->mutex);
+}
+
+// Acquire a lock
+void lock_acquire(my_lock_t* lock) {
+  pthread_mutex_lock(&lock->mutex);
+}
+
+// Try to acquire a lock without waiting. Returns true if the lock was acquired.
+bool lock_try_acquire(my_lock_t* lock) {
+  return pthread_mutex_trylock(&lock->mutex) == 0;
+}
+
+// Release a lock
+void lock_release(my_lock_t* lock) {
+  SCHED_POINT();
+  pthread_mutex_unlock(&lock->mutex);
+}
+
+#else
+
+// Lock implementation: three-state futex mutex (Drepper, "Futexes Are Tricky"). Critical
+// sections in the data structures are a few dozen instructions, so a waiter first spins for
+// up to LOCK_SPINS iterations hoping the holder finishes, and only then sleeps in the kernel.
+// The uncontended acquire and release are a single atomic instruction each.
+
+#define UNLOCKED 0
+#define LOCKED 1
+#define CONTENDED 2
+
+// Spinning cannot help on a single CPU: the holder cannot run while we spin.
+static int spin_limit(){
+  static const int limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? LOCK_SPINS : 0;
+  return limit;
+}
+
+// Sleep until the lock state is no longer val
+static void futex_wait(int* addr, int val){
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+// Wake one thread sleeping on addr
+static void futex_wake(int* addr){
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Initialize a lock
+void lock_init(my_lock_t* lock) {
+  lock->state = UNLOCKED;
+}
+
+// Destroy a lock
+void lock_destroy(my_lock_t* lock) {
+  lock->state = UNLOCKED;
+}
+
+// Try to acquire a lock without waiting. Returns true if the lock was acquired.
+bool lock_try_acquire(my_lock_t* lock) {
+  int expected = UNLOCKED;
+  return __atomic_compare_exchange_n(&lock->state, &expected, LOCKED, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+// Acquire a lock, spinning briefly and then sleeping until it is free
+void lock_acquire(my_lock_t* lock) {
+  if(lock_try_acquire(lock)) return; // Fast path: uncontended
+  // Spin phase: only read the state while waiting so the line stays shared
+  for(int i=0; i < spin_limit(); i++){
+    cpu_relax();
+    if(__atomic_load_n(&lock->state, __ATOMIC_RELAXED) == UNLOCKED && lock_try_acquire(lock)) return;
+  }
+  // Park phase: mark the lock contended so the holder knows to wake us
+  while(__atomic_exchange_n(&lock->state, CONTENDED, __ATOMIC_ACQUIRE) != UNLOCKED){
+    futex_wait(&lock->state, CONTENDED);
+  }
+}
+
+// Release a lock
+void lock_release(my_lock_t* lock) {
+  SCHED_POINT();
+  // Only pay for the syscall if someone may be sleeping
+  if(__atomic_exchange_n(&lock->state, UNLOCKED, __ATOMIC_RELEASE) == CONTENDED){
+    futex_wake(&lock->state);
+  }
+}
+
+#endif
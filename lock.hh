@@ -0,0 +1,57 @@
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#define LOCK_SPINS 100 // Bounded spin before parking a thread in the kernel
+#define CACHE_LINE 64
+
+// Adaptive lock: spins briefly with pause, then parks on a futex.
+// Build with -DPTHREAD_LOCKS to fall back to a plain pthread mutex.
+typedef struct my_lock {
+#ifdef PTHREAD_LOCKS
+  pthread_mutex_t mutex;
+#else
+  int state; // 0 unlocked, 1 locked, 2 locked with (possible) waiters parked on the futex
+#endif
+} my_lock_t;
+
+// Hint to the CPU that we are in a spin-wait loop
+static inline void cpu_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield" ::: "memory");
+#else
+  __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+// Schedule point: a place inside an operation where another thread's step may land. Stress
+// builds (-DSCHED_POINTS, linking lincheck.cc) delay the caller there at random, so single-CPU
+// runs reach interleavings that preemption alone almost never produces. Otherwise it is empty.
+#ifdef SCHED_POINTS
+extern int sched_perturb; // Chance out of 1024 of a delay at each point, 0 while not testing
+void sched_point();
+#define SCHED_POINT() sched_point()
+#else
+#define SCHED_POINT()
+#endif
+
+// Initialize a lock
+void lock_init(my_lock_t* lock);
+
+// Destroy a lock
+void lock_destroy(my_lock_t* lock);
+
+// Acquire a lock, spinning briefly and then sleeping until it is free
+void lock_acquire(my_lock_t* lock);
+
+// Try to acquire a lock without waiting. Returns true if the lock was acquired.
+bool lock_try_acquire(my_lock_t* lock);
+
+// Release a lock
+void lock_release(my_lock_t* lock);
+
+#endif
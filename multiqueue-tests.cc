@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include "multiqueue.hh"
+
+#define NUM_PRODUCERS 8
+#define NUM_CONSUMERS 4
+#define PUTS_PER_PRODUCER 20000
+
+/****** Multi-Queue Invariants ******/
+
+// Invariant 1
+// For every value V that has been put onto the queue p times and returned by take q times, there must be p-q copies of this value on the queue. This only holds if p >= q.
+
+// Invariant 2
+// No value should ever be returned by take if it was not first passed to put by some thread.
+
+// Invariant 3
+// If a thread puts value A and then puts value B, and no other thread puts these specific values, B must not be taken from the queue before taking A.
+// Unlike my_queue_t, values put by different threads may be taken in any order.
+
+typedef struct producer_args {
+  my_multi_queue_t *q;
+  int id;
+} producer_args_t;
+
+typedef struct consumer_args {
+  my_multi_queue_t *q;
+  int last[NUM_PRODUCERS]; // Last sequence number taken from each producer
+  long taken;
+  bool in_order;
+} consumer_args_t;
+
+// Worker thread for tests: put this producer's values in sequence
+void* put_worker(void* arg){
+  producer_args_t *args = (producer_args_t*) arg;
+  for(int i=0; i < PUTS_PER_PRODUCER; i++){
+    multi_queue_put(args->q, args->id * PUTS_PER_PRODUCER + i);
+  }
+  pthread_exit(0);
+}
+
+// Worker thread for tests: take until the total has been taken, checking per-producer order
+void* take_worker(void* arg){
+  consumer_args_t *args = (consumer_args_t*) arg;
+  static long total = 0;
+  int val;
+  while(__atomic_load_n(&total, __ATOMIC_RELAXED) < NUM_PRODUCERS * PUTS_PER_PRODUCER){
+    if(!multi_queue_poll(args->q, &val)) continue;
+    __atomic_fetch_add(&total, 1, __ATOMIC_RELAXED);
+    int producer = val / PUTS_PER_PRODUCER, seq = val % PUTS_PER_PRODUCER;
+    if(seq <= args->last[producer]) args->in_order = false;
+    args->last[producer] = seq;
+    args->taken++;
+  }
+  pthread_exit(0);
+}
+
+/****** Begin Tests ******/
+// A test of invariant 3, with producers and consumers running at once
+TEST(MultiQueueTest, Invariant3){
+  my_multi_queue_t q;
+  multi_queue_init(&q, 4);
+
+  pthread_t producers[NUM_PRODUCERS], consumers[NUM_CONSUMERS];
+  producer_args_t pargs[NUM_PRODUCERS];
+  consumer_args_t cargs[NUM_CONSUMERS];
+  for(int i=0; i < NUM_CONSUMERS; i++){
+    cargs[i].q = &q;
+    for(int p=0; p < NUM_PRODUCERS; p++) cargs[i].last[p] = -1;
+    cargs[i].taken = 0;
+    cargs[i].in_order = true;
+    if(pthread_create(&consumers[i], NULL, take_worker, &cargs[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_PRODUCERS; i++){
+    pargs[i].q = &q;
+    pargs[i].id = i;
+    if(pthread_create(&producers[i], NULL, put_worker, &pargs[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_PRODUCERS; i++){ // Wait for threads to exit
+    if(pthread_join(producers[i], NULL) != 0) perror("Could not exit thread");
+  }
+  long taken = 0;
+  for(int i=0; i < NUM_CONSUMERS; i++){
+    if(pthread_join(consumers[i], NULL) != 0) perror("Could not exit thread");
+    ASSERT_TRUE(cargs[i].in_order);
+    taken += cargs[i].taken;
+  }
+  ASSERT_EQ(NUM_PRODUCERS * PUTS_PER_PRODUCER, taken);
+  ASSERT_TRUE(multi_queue_empty(&q));
+
+  // Clean up
+  multi_queue_destroy(&q);
+}
+
+// A test of invariants 1 and 2: every value put is taken exactly once, and nothing else is
+TEST(MultiQueueTest, Invariant1){
+  my_multi_queue_t q;
+  multi_queue_init(&q, 0); // One inner queue per CPU
+
+  pthread_t producers[NUM_PRODUCERS];
+  producer_args_t pargs[NUM_PRODUCERS];
+  for(int i=0; i < NUM_PRODUCERS; i++){
+    pargs[i].q = &q;
+    pargs[i].id = i;
+    if(pthread_create(&producers[i], NULL, put_worker, &pargs[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_PRODUCERS; i++){ // Wait for threads to exit
+    if(pthread_join(producers[i], NULL) != 0) perror("Could not exit thread");
+  }
+  ASSERT_EQ(NUM_PRODUCERS * PUTS_PER_PRODUCER, multi_queue_size(&q));
+
+  // Taking from one thread steals from every inner queue
+  char *seen = (char*) calloc(NUM_PRODUCERS * PUTS_PER_PRODUCER, 1);
+  int val;
+  while((val = multi_queue_take(&q)) != -1){
+    ASSERT_GE(val, 0);
+    ASSERT_LT(val, NUM_PRODUCERS * PUTS_PER_PRODUCER);
+    ASSERT_EQ(0, seen[val]);
+    seen[val] = 1;
+  }
+  for(int i=0; i < NUM_PRODUCERS * PUTS_PER_PRODUCER; i++){
+    ASSERT_EQ(1, seen[i]);
+  }
+  free(seen);
+
+  // Clean up
+  multi_queue_destroy(&q);
+}
+
+// Basic functionality for the multi-queue
+TEST(MultiQueueTest, BasicMultiQueueOps){
+  my_multi_queue_t q;
+  multi_queue_init(&q, 3);
+  ASSERT_EQ(3, q.nshards);
+  ASSERT_TRUE(multi_queue_empty(&q));
+  ASSERT_EQ(-1, multi_queue_take(&q));
+
+  // One thread's values come back in order
+  for(int i=0; i < 100; i++){
+    multi_queue_put(&q, i);
+  }
+  ASSERT_EQ(100, multi_queue_size(&q));
+  for(int i=0; i < 100; i++){
+    ASSERT_EQ(i, multi_queue_take(&q));
+  }
+
+  // -1 can be told apart from empty with poll
+  multi_queue_put(&q, -1);
+  int val;
+  ASSERT_TRUE(multi_queue_poll(&q, &val));
+  ASSERT_EQ(-1, val);
+  ASSERT_FALSE(multi_queue_poll(&q, &val));
+
+  // Clean up
+  multi_queue_destroy(&q);
+}
@@ -0,0 +1,110 @@
+#include "multiqueue.hh"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Multi-queue implementation (relaxed FIFO): nshards independent two-lock queues. Every thread
+// has a home shard, handed out round-robin on first use. Producers only ever put into their
+// home shard, so one producer's elements sit in one FIFO and are taken in the order they were
+// put (Invariant 3), while producers with different homes never share a lock. Consumers take
+// from their home shard first; when it is empty they pick two other shards at random and take
+// from the longer one ("power of two choices"), and only if both are empty do they steal by
+// scanning every shard. Across producers there is no ordering at all.
+
+static int next_home = 0; // Next home shard handed out to a new thread
+static __thread int my_home = -1; // This thread's home, assigned on first use
+static __thread unsigned int my_seed = 0; // This thread's random state
+
+// Get the home shard of the calling thread
+static int mq_home(my_multi_queue_t* queue){
+  if(my_home == -1) my_home = __atomic_fetch_add(&next_home, 1, __ATOMIC_RELAXED);
+  return my_home % queue->nshards;
+}
+
+// Draw a random shard index (xorshift, per thread)
+static int mq_random(my_multi_queue_t* queue){
+  if(my_seed == 0) my_seed = 2654435761u * (mq_home(queue) + 1);
+  my_seed ^= my_seed << 13;
+  my_seed ^= my_seed >> 17;
+  my_seed ^= my_seed << 5;
+  return my_seed % queue->nshards;
+}
+
+// Initialize a multi-queue with the given number of inner queues (0 for one per CPU). Elements
+// from one producer thread keep their order; there is no order across producers.
+void multi_queue_init(my_multi_queue_t* queue, int shards) {
+  if(shards <= 0) shards = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if(shards > MQ_MAX_SHARDS) shards = MQ_MAX_SHARDS;
+  if(shards < 1) shards = 1;
+  queue->shards = (mq_shard_t*) aligned_alloc(CACHE_LINE, sizeof(mq_shard_t) * shards);
+  if(queue->shards == NULL) perror("Could not allocate space");
+  queue->nshards = shards;
+  for(int i=0; i<shards; i++){
+    queue_init(&queue->shards[i].queue);
+    queue->shards[i].length = 0;
+  }
+}
+
+// Destroy a multi-queue
+void multi_queue_destroy(my_multi_queue_t* queue) {
+  for(int i=0; i<queue->nshards; i++){
+    queue_destroy(&queue->shards[i].queue);
+  }
+  free(queue->shards);
+  queue->shards = NULL;
+}
+
+// Put an element at the end of the calling thread's inner queue
+void multi_queue_put(my_multi_queue_t* queue, int element) {
+  mq_shard_t *shard = &queue->shards[mq_home(queue)];
+  queue_put(&shard->queue, element);
+  __atomic_fetch_add(&shard->length, 1, __ATOMIC_RELAXED);
+}
+
+// mq_shard_take takes an element from one shard. Returns true if one was taken.
+static bool mq_shard_take(mq_shard_t* shard, int* element){
+  if(__atomic_load_n(&shard->length, __ATOMIC_RELAXED) <= 0) return false; // Skip the lock
+  if(!queue_poll(&shard->queue, element)) return false;
+  __atomic_fetch_sub(&shard->length, 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+// Take an element from the calling thread's inner queue, or from the longer of two others
+// if it is empty. Returns true and stores the element if one was taken, false only if every
+// inner queue was found empty.
+bool multi_queue_poll(my_multi_queue_t* queue, int* element) {
+  int home = mq_home(queue);
+  if(mq_shard_take(&queue->shards[home], element)) return true;
+  if(queue->nshards > 2){
+    int a = mq_random(queue), b = mq_random(queue);
+    if(__atomic_load_n(&queue->shards[a].length, __ATOMIC_RELAXED) <
+       __atomic_load_n(&queue->shards[b].length, __ATOMIC_RELAXED)) a = b;
+    if(mq_shard_take(&queue->shards[a], element)) return true;
+  }
+  for(int i=1; i<queue->nshards; i++){ // Steal from whichever shard has something
+    if(mq_shard_take(&queue->shards[(home + i) % queue->nshards], element)) return true;
+  }
+  return false;
+}
+
+// Take an element as multi_queue_poll does, or return -1 if every inner queue was found empty
+int multi_queue_take(my_multi_queue_t* queue) {
+  int element;
+  if(!multi_queue_poll(queue, &element)) return -1;
+  return element;
+}
+
+// Check if a multi-queue is empty (exact once writers are quiescent)
+bool multi_queue_empty(my_multi_queue_t* queue) {
+  return multi_queue_size(queue) == 0;
+}
+
+// Get the number of elements in a multi-queue (exact once writers are quiescent)
+long multi_queue_size(my_multi_queue_t* queue) {
+  long size = 0;
+  for(int i=0; i<queue->nshards; i++){
+    size += __atomic_load_n(&queue->shards[i].length, __ATOMIC_RELAXED);
+  }
+  return size;
+}
@@ -0,0 +1,46 @@
+#ifndef MULTIQUEUE_H
+#define MULTIQUEUE_H
+
+#include <stdbool.h>
+
+#include "queue.hh"
+#include "lock.hh"
+
+#define MQ_MAX_SHARDS 64 // Most inner queues a multi-queue can have
+
+// One inner queue and its length, on lines of its own
+typedef struct mq_shard {
+  my_queue_t queue;
+  long length; // Elements in this shard, compared by consumers choosing where to take from
+} __attribute__((aligned(CACHE_LINE))) mq_shard_t;
+
+typedef struct my_multi_queue {
+  mq_shard_t *shards;
+  int nshards;
+} my_multi_queue_t;
+
+// Initialize a multi-queue with the given number of inner queues (0 for one per CPU). Elements
+// from one producer thread keep their order; there is no order across producers.
+void multi_queue_init(my_multi_queue_t* queue, int shards);
+
+// Destroy a multi-queue
+void multi_queue_destroy(my_multi_queue_t* queue);
+
+// Put an element at the end of the calling thread's inner queue
+void multi_queue_put(my_multi_queue_t* queue, int element);
+
+// Take an element from the calling thread's inner queue, or from the longer of two others
+// if it is empty. Returns true and stores the element if one was taken, false only if every
+// inner queue was found empty.
+bool multi_queue_poll(my_multi_queue_t* queue, int* element);
+
+// Take an element as multi_queue_poll does, or return -1 if every inner queue was found empty
+int multi_queue_take(my_multi_queue_t* queue);
+
+// Check if a multi-queue is empty (exact once writers are quiescent)
+bool multi_queue_empty(my_multi_queue_t* queue);
+
+// Get the number of elements in a multi-queue (exact once writers are quiescent)
+long multi_queue_size(my_multi_queue_t* queue);
+
+#endif
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "queue.hh"
+#include "lincheck.hh"
 
 /****** Queue Invariants ******/
 
@@ -13,6 +14,9 @@
 // Invariant 3
 // If a thread puts value A and then puts value B, and no other thread puts these specific values, B must not be taken from the queue before taking A.
 
+// Invariant 4
+// Every history of concurrent puts and takes is linearizable: each operation appears to take effect at one instant between its call and its return, in an order a sequential queue would accept.
+
 typedef struct put_args {
   my_queue_t *s;
   int val;
@@ -133,6 +137,7 @@ TEST(QueueTest, BasicQueueOps) {
 
   // Make sure the queue is not empty
   ASSERT_FALSE(queue_empty(&q));
+  ASSERT_EQ(3, queue_size(&q));
 
   // Take the values from the queue and check them
   ASSERT_EQ(1, queue_take(&q));
@@ -141,7 +146,170 @@ TEST(QueueTest, BasicQueueOps) {
 
   // Make sure the queue is empty
   ASSERT_TRUE(queue_empty(&q));
+  ASSERT_EQ(0, queue_size(&q));
+
+  // Clean up
+  queue_destroy(&q);
+}
+
+// Non-blocking put/take
+TEST(QueueTest, TryQueueOps) {
+  my_queue_t q;
+  queue_init(&q);
+  int val = 0;
+
+  // Nothing to take from an empty queue
+  ASSERT_FALSE(queue_try_take(&q, &val));
+
+  // Uncontended puts and takes always succeed
+  ASSERT_TRUE(queue_try_put(&q, 1));
+  ASSERT_TRUE(queue_try_put(&q, 2));
+  ASSERT_TRUE(queue_try_take(&q, &val));
+  ASSERT_EQ(1, val);
+
+  // A held lock makes the matching end fail fast
+  lock_acquire(&q.tail_lock);
+  ASSERT_FALSE(queue_try_put(&q, 3));
+  lock_release(&q.tail_lock);
+  lock_acquire(&q.head_lock);
+  ASSERT_FALSE(queue_try_take(&q, &val));
+  lock_release(&q.head_lock);
+
+  ASSERT_EQ(2, queue_take(&q));
+  ASSERT_TRUE(queue_empty(&q));
 
   // Clean up
   queue_destroy(&q);
 }
+
+#define FC_THREADS 8
+#define FC_PUTS 10000
+
+// Worker thread for flat-combining test: put val * FC_PUTS + i for increasing i
+void* put_many_worker(void* arg){
+  put_args_t *args = (put_args_t*) arg;
+  for(int i=0; i < FC_PUTS; i++){
+    queue_put(args->s, args->val * FC_PUTS + i);
+  }
+  pthread_exit(0);
+}
+
+// Invariants 1 and 3 in flat-combining mode: every put is applied once and per-thread order holds
+TEST(QueueTest, CombiningInvariant3) {
+  my_queue_t q;
+  queue_init_combining(&q);
+
+  put_args_t args[FC_THREADS];
+  pthread_t workers[FC_THREADS];
+  for(int i=0; i < FC_THREADS; i++){
+    args[i].s = &q;
+    args[i].val = i;
+    if(pthread_create(&workers[i], NULL, put_many_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < FC_THREADS; i++){ // Wait for threads to exit
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  int next[FC_THREADS] = {0}; // Next value expected from each thread
+  int val;
+  while((val = queue_take(&q)) != -1){
+    int thread = val / FC_PUTS;
+    ASSERT_EQ(next[thread], val % FC_PUTS);
+    next[thread]++;
+  }
+  for(int i=0; i < FC_THREADS; i++){
+    ASSERT_EQ(FC_PUTS, next[i]);
+  }
+
+  // Clean up
+  queue_destroy(&q);
+}
+
+#define REBUILDS 20
+
+static my_queue_t *live_queue; // Queue the churn workers currently use
+static int stop_churn;
+
+// Worker thread for the rebuild test: put and take on whichever queue is live
+void* churn_worker(void* arg){
+  long bad = 0;
+  for(int i=0; !__atomic_load_n(&stop_churn, __ATOMIC_ACQUIRE); i++){
+    my_queue_t *q = __atomic_load_n(&live_queue, __ATOMIC_ACQUIRE);
+    queue_put(q, i % 100);
+    int val = queue_take(q);
+    if(val < -1 || val >= 100) bad++; // Only put values, or -1 once destroyed
+  }
+  return (void*) bad;
+}
+
+// Queues can be destroyed and replaced while other threads are still using them
+TEST(QueueTest, OnlineRebuild) {
+  my_queue_t queues[REBUILDS + 1];
+  queue_init(&queues[0]);
+  live_queue = &queues[0];
+  stop_churn = 0;
+
+  pthread_t workers[FC_THREADS];
+  for(int i=0; i < FC_THREADS; i++){
+    if(pthread_create(&workers[i], NULL, churn_worker, NULL) != 0) perror("Could not create thread");
+  }
+  for(int r=1; r <= REBUILDS; r++){
+    if(r % 2 == 0) queue_init_combining(&queues[r]);
+    else queue_init(&queues[r]);
+    __atomic_store_n(&live_queue, &queues[r], __ATOMIC_RELEASE);
+    queue_destroy(&queues[r - 1]); // Threads may still be inside it
+    ASSERT_EQ(-1, queue_take(&queues[r - 1]));
+    ASSERT_TRUE(queue_empty(&queues[r - 1]));
+    ASSERT_EQ(0, queue_size(&queues[r - 1]));
+  }
+  __atomic_store_n(&stop_churn, 1, __ATOMIC_RELEASE);
+  for(int i=0; i < FC_THREADS; i++){
+    void *bad;
+    if(pthread_join(workers[i], &bad) != 0) perror("Could not exit thread");
+    ASSERT_EQ(NULL, bad);
+  }
+
+  // Clean up
+  queue_destroy(&queues[REBUILDS]);
+}
+
+// Round for the linearizability test: a random mix of puts and takes, some of them tries
+void lincheck_queue_round(my_history_t* history, void* target, int thread, int first, int ops){
+  my_queue_t *queue = (my_queue_t*) target;
+  for(int i=0; i < ops; i++){
+    unsigned int choice = history_random(history, thread) % 8;
+    lincheck_op_t *op = history_invoke(history, thread, choice < 4 ? LINCHECK_PUT : LINCHECK_TAKE, 0, choice < 4 ? first + i : 0);
+    int result = -1;
+    bool ok = true;
+    if(choice < 3) queue_put(queue, first + i);
+    else if(choice == 3) ok = queue_try_put(queue, first + i);
+    else if(choice < 7) result = queue_take(queue);
+    else ok = queue_try_take(queue, &result);
+    history_respond(history, op, ok ? result : -1, ok);
+  }
+}
+
+// Drain for the linearizability test: take until the queue is empty
+void lincheck_queue_drain(my_history_t* history, void* target, int thread, int first, int ops){
+  my_queue_t *queue = (my_queue_t*) target;
+  int result;
+  do {
+    lincheck_op_t *op = history_invoke(history, thread, LINCHECK_TAKE, 0, 0);
+    result = queue_take(queue);
+    history_respond(history, op, result, true);
+  } while(result != -1);
+}
+
+// A test of invariant 4 in every mode, with operations delayed at random
+TEST(QueueTest, Linearizable) {
+  lincheck_state_t empty;
+  empty.length = 0;
+  my_queue_t q;
+  for(int mode=0; mode < 2; mode++){
+    if(mode == 0) queue_init(&q);
+    else queue_init_combining(&q);
+    ASSERT_EQ(0, lincheck_run(&q, lincheck_queue_round, lincheck_queue_drain, lincheck_queue_step, &empty,
+                              LINCHECK_THREADS, LINCHECK_OPS, LINCHECK_ROUNDS, LINCHECK_PERTURB, mode + 1));
+    queue_destroy(&q);
+  }
+}
@@ -3,25 +3,34 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "epoch.hh"
+
 #define HEAD_LOCK 0
 #define TAIL_LOCK 1
 #define BOTH_LOCKS 2
 
+// Queue implementation: two-lock queue with a dummy node at the head. put only touches the tail
+// and take only touches head->next, so the two ends never need to be locked together and the
+// size counter is purely informational.
+// Every operation runs inside an epoch critical section, so queue_destroy can close the queue
+// and wait for operations already running to finish before freeing anything; operations that
+// arrive after that see an empty queue.
+
 // Function to lock tail & head to prevent deadlock
-// Threshold represents size below which both lock shoudl be locked.
+// Threshold represents (approximate) size below which both lock shoudl be locked.
 // Def_lock is the lock to be locked if both do not need to be locked.
 // Returns true if both are locked.
 bool atomic_lock(my_queue_t* queue, int threshold,int def_lock){
   // If queue is small, or def_lock is both, we need both locks.
-  if(queue->size <= threshold || def_lock == BOTH_LOCKS){
+  if(counter_read_approx(&queue->size) <= threshold || def_lock == BOTH_LOCKS){
     // Always lock tail first
-    pthread_mutex_lock(&queue->tail_lock);
-    pthread_mutex_lock(&queue->head_lock);
+    lock_acquire(&queue->tail_lock);
+    lock_acquire(&queue->head_lock);
     return true;
   } else if(def_lock == HEAD_LOCK){
-    pthread_mutex_lock(&queue->head_lock);
+    lock_acquire(&queue->head_lock);
   } else if(def_lock == TAIL_LOCK){
-    pthread_mutex_lock(&queue->tail_lock);
+    lock_acquire(&queue->tail_lock);
   }
   return false;
 }
@@ -32,73 +41,190 @@ bool atomic_lock(my_queue_t* queue, int threshold,int def_lock){
 void atomic_unlock(my_queue_t* queue, bool both, int def_lock){
   // If queue is small, or def_lock is both, unlock it as well.
   if(both){
-    pthread_mutex_unlock(&queue->head_lock);
-    pthread_mutex_unlock(&queue->tail_lock);
+    lock_release(&queue->head_lock);
+    lock_release(&queue->tail_lock);
   } else if(def_lock == HEAD_LOCK){
-    pthread_mutex_unlock(&queue->head_lock);
+    lock_release(&queue->head_lock);
   }else if(def_lock == TAIL_LOCK){
-    pthread_mutex_unlock(&queue->tail_lock);
+    lock_release(&queue->tail_lock);
   }
 }
 
 // Initialize a new queue
 void queue_init(my_queue_t* queue) {
-  if(pthread_mutex_init(&queue->tail_lock, NULL) != 0) perror("Could not initialize mutex lock");
-  if(pthread_mutex_init(&queue->head_lock, NULL) != 0) perror("Could not initialize mutex lock");
-  queue->tail = NULL;
-  queue->head = NULL;
-  queue->size = 0;
+  lock_init(&queue->tail_lock);
+  lock_init(&queue->head_lock);
+  node_t *dummy = (node_t*)malloc(sizeof(node_t));
+  if(dummy == NULL) perror("Could not allocate space");
+  dummy->next = NULL;
+  queue->tail = dummy;
+  queue->head = dummy;
+  counter_init(&queue->size);
+  queue->put_fc = NULL;
+  queue->take_fc = NULL;
+  queue->closed = 0;
+}
+
+// Initialize a queue in flat-combining mode
+void queue_init_combining(my_queue_t* queue) {
+  queue_init(queue);
+  queue->put_fc = fc_create();
+  queue->take_fc = fc_create();
 }
 
 // Destroy a queue
 void queue_destroy(my_queue_t* queue) {
+  epoch_close(&queue->closed);
   atomic_lock(queue, 0, BOTH_LOCKS);
   node_t *temp = queue->head;
-  for(node_t *current = queue->head; current != NULL;){ // free all nodes sequentially
+  for(node_t *current = queue->head; current != NULL;){ // free all nodes sequentially, dummy included
     temp = current;
     current = temp->next;
     free(temp);
   }
-  queue->size = 0;
+  queue->head = NULL;
+  queue->tail = NULL;
+  counter_init(&queue->size);
+  if(queue->put_fc != NULL) fc_destroy(queue->put_fc);
+  if(queue->take_fc != NULL) fc_destroy(queue->take_fc);
+  queue->put_fc = NULL;
+  queue->take_fc = NULL;
+  atomic_unlock(queue, true, BOTH_LOCKS);
+}
+
+// Allocate a node for element. Done outside the lock to keep the critical section short.
+static node_t* queue_node(int element){
+  node_t *node = (node_t*)malloc(sizeof(node_t));
+  if(node == NULL) perror("Could not allocate space");
+  node->data = element;
+  node->next = NULL;
+  return node;
+}
+
+// Link a node in at the tail. The caller must hold the tail lock.
+static void queue_link(my_queue_t* queue, node_t* node){
+  // Publish the node; when the queue is empty the tail is the dummy that take reads next from
+  __atomic_store_n(&queue->tail->next, node, __ATOMIC_RELEASE);
+  SCHED_POINT();
+  queue->tail = node;
+}
+
+// Apply a published put on behalf of another thread (flat-combining mode)
+static void queue_apply_put(void* structure, fc_slot_t* slot){
+  queue_link((my_queue_t*) structure, (node_t*) slot->node);
 }
 
 // Put an element at the end of a queue
 void queue_put(my_queue_t* queue, int element) {
-  bool both_unlock = atomic_lock(queue, 2, TAIL_LOCK); // Lock both locks if queue is small
-  node_t *new_node = (node_t*)malloc(sizeof(node_t));
-  if(new_node == NULL) perror("Could not allocate space");
-  new_node->data = element;
-  new_node->next = NULL;
-  // If there is older tail, set next to new node
-  if(queue->size > 0) {
-    queue->tail->next = new_node;
+  if(!epoch_enter_open(&queue->closed)) return;
+  node_t *new_node = queue_node(element);
+  if(queue->put_fc != NULL){
+    fc_slot_t done;
+    fc_execute(queue->put_fc, &queue->tail_lock, queue, queue_apply_put, 0, new_node, &done);
+  } else {
+    lock_acquire(&queue->tail_lock);
+    queue_link(queue, new_node);
+    lock_release(&queue->tail_lock);
+  }
+  counter_add(&queue->size, 1);
+  epoch_exit();
+}
+
+// Put an element at the end of a queue unless another thread holds the tail lock.
+// Returns true if the element was put.
+bool queue_try_put(my_queue_t* queue, int element) {
+  if(!epoch_enter_open(&queue->closed)) return false;
+  node_t *new_node = queue_node(element);
+  bool put = lock_try_acquire(&queue->tail_lock);
+  if(put){
+    queue_link(queue, new_node);
+    lock_release(&queue->tail_lock);
+    counter_add(&queue->size, 1);
   } else {
-    queue->head = new_node;
+    free(new_node);
   }
-  queue->tail = new_node;
-  queue->size++;
-  atomic_unlock(queue, both_unlock, TAIL_LOCK);
+  epoch_exit();
+  return put;
 }
 
 // Check if a queue is empty
 bool queue_empty(my_queue_t* queue) {
-  if(queue->size == 0) return true;
-  return false;
+  if(!epoch_enter_open(&queue->closed)) return true;
+  lock_acquire(&queue->head_lock);
+  bool empty = __atomic_load_n(&queue->head->next, __ATOMIC_ACQUIRE) == NULL;
+  lock_release(&queue->head_lock);
+  epoch_exit();
+  return empty;
+}
+
+// Get the number of elements in a queue (exact once writers are quiescent)
+long queue_size(my_queue_t* queue) {
+  if(!epoch_enter_open(&queue->closed)) return 0;
+  long size = counter_read(&queue->size);
+  epoch_exit();
+  return size;
+}
+
+// Unlink the first value's node. The caller must hold the head lock.
+// Returns the old dummy node for the caller to free, or NULL if the queue is empty.
+static node_t* queue_unlink(my_queue_t* queue, int* element){
+  node_t *first = __atomic_load_n(&queue->head->next, __ATOMIC_ACQUIRE);
+  if(first == NULL) return NULL;
+  *element = first->data;
+  SCHED_POINT();
+  node_t *temp = queue->head;
+  queue->head = first; // First value's node becomes the new dummy
+  return temp;
+}
+
+// Apply a published take on behalf of another thread (flat-combining mode)
+static void queue_apply_take(void* structure, fc_slot_t* slot){
+  slot->node = queue_unlink((my_queue_t*) structure, &slot->result);
 }
 
 // Take an element off the front of a queue
 int queue_take(my_queue_t* queue) {
-  bool both_unlock = atomic_lock(queue, 2, HEAD_LOCK); // Lock both locks if queue is small
-  if(queue->size == 0){ // If empty queue, unlock & return -1
-    atomic_unlock(queue, true, 0);
-    return -1;
-  } else{
-    int val = queue->head->data;
-    node_t *temp = queue->head;
-    queue->head = queue->head->next;
+  int val;
+  if(!queue_poll(queue, &val)) return -1; // If empty queue, return -1
+  return val;
+}
+
+// Take an element off the front of a queue, telling an empty queue apart from a -1 element.
+// Returns true and stores the element if one was taken, false if the queue is empty.
+bool queue_poll(my_queue_t* queue, int* element) {
+  if(!epoch_enter_open(&queue->closed)) return false;
+  node_t *temp;
+  if(queue->take_fc != NULL){
+    fc_slot_t done;
+    fc_execute(queue->take_fc, &queue->head_lock, queue, queue_apply_take, 0, NULL, &done);
+    temp = (node_t*) done.node;
+    *element = done.result;
+  } else {
+    lock_acquire(&queue->head_lock);
+    temp = queue_unlink(queue, element);
+    lock_release(&queue->head_lock);
+  }
+  if(temp != NULL){
+    free(temp);
+    counter_add(&queue->size, -1);
+  }
+  epoch_exit();
+  return temp != NULL;
+}
+
+// Take an element off the front of a queue unless another thread holds the head lock.
+// Returns true and stores the element if one was taken, false if the queue is busy or empty.
+bool queue_try_take(my_queue_t* queue, int* element) {
+  if(!epoch_enter_open(&queue->closed)) return false;
+  node_t *temp = NULL;
+  if(lock_try_acquire(&queue->head_lock)){
+    temp = queue_unlink(queue, element);
+    lock_release(&queue->head_lock);
+  }
+  if(temp != NULL){
     free(temp);
-    queue->size--;
-    atomic_unlock(queue, both_unlock, HEAD_LOCK);
-    return val;
+    counter_add(&queue->size, -1);
   }
+  epoch_exit();
+  return temp != NULL;
 }
@@ -4,21 +4,33 @@
 #include <stdbool.h>
 #include <pthread.h>
 
+#include "counter.hh"
+#include "lock.hh"
+#include "combine.hh"
+
 typedef struct node{
   int data;
   struct node* next; // Next points backwards, towards the tail
 } node_t;
 
 typedef struct my_queue {
-  node_t *head, *tail;
-  pthread_mutex_t head_lock, tail_lock; // One lock for head, one for tail
-  int size;
+  node_t *head, *tail; // Head is always a dummy node; the first value lives in head->next
+  my_lock_t head_lock, tail_lock; // One lock for head, one for tail
+  my_counter_t size; // Sharded so put and take never contend on one size field
+  fc_t *put_fc, *take_fc; // Publication slots for each end in flat-combining mode, NULL otherwise
+  int closed; // Set by queue_destroy; later operations see an empty queue
 } my_queue_t;
 
 // Initialize a queue
 void queue_init(my_queue_t* queue);
 
-// Destroy a queue
+// Initialize a queue in flat-combining mode: puts and takes are published and applied in
+// batches by whichever thread holds the tail or head lock
+void queue_init_combining(my_queue_t* queue);
+
+// Destroy a queue. Operations already running on other threads finish first; later ones act
+// as on an empty queue, so a queue can be replaced online by publishing a new one and then
+// destroying the old one. The my_queue_t itself must stay allocated while threads may use it.
 void queue_destroy(my_queue_t* queue);
 
 // Put an element at the end of a queue
@@ -27,9 +39,24 @@ void queue_put(my_queue_t* queue, int element);
 // Chekc if a queue is empty
 bool queue_empty(my_queue_t* queue);
 
+// Get the number of elements in a queue (exact once writers are quiescent)
+long queue_size(my_queue_t* queue);
+
 // Take an element off the front of a queue
 int queue_take(my_queue_t* queue);
 
+// Take an element off the front of a queue, telling an empty queue apart from a -1 element.
+// Returns true and stores the element if one was taken, false if the queue is empty.
+bool queue_poll(my_queue_t* queue, int* element);
+
+// Put an element at the end of a queue unless another thread holds the tail lock.
+// Returns true if the element was put.
+bool queue_try_put(my_queue_t* queue, int element);
+
+// Take an element off the front of a queue unless another thread holds the head lock.
+// Returns true and stores the element if one was taken, false if the queue is busy or empty.
+bool queue_try_take(my_queue_t* queue, int* element);
+
 // Function to lock tail & head to prevent deadlock
 bool atomic_lock(my_queue_t* queue, int threshold, int def_lock);
 
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include "segqueue.hh"
+
+#define NUM_THREADS 8
+#define PUTS_PER_THREAD 20000
+
+/****** Segmented Queue Invariants ******/
+
+// The segmented queue must keep the three queue invariants:
+
+// Invariant 1
+// For every value V that has been put onto the queue p times and returned by take q times, there must be p-q copies of this value on the queue. This only holds if p >= q.
+
+// Invariant 2
+// No value should ever be returned by take if it was not first passed to put by some thread.
+
+// Invariant 3
+// If a thread puts value A and then puts value B, and no other thread puts these specific values, B must not be taken from the queue before taking A.
+
+/****** Begin Tests ******/
+
+typedef struct put_args {
+  my_seg_queue_t *q;
+  int id;
+} put_args_t;
+
+typedef struct take_args {
+  my_seg_queue_t *q;
+  int taken[NUM_THREADS]; // Values taken from each producer
+  bool in_order; // False if some producer's values came out of order
+} take_args_t;
+
+int total_taken = 0; // Values taken by all consumers so far
+
+// Producer thread: put id * PUTS_PER_THREAD + i for increasing i
+void* put_worker(void* arg){
+  put_args_t *args = (put_args_t*) arg;
+  for(int i=0; i < PUTS_PER_THREAD; i++){
+    seg_queue_put(args->q, args->id * PUTS_PER_THREAD + i);
+  }
+  pthread_exit(0);
+}
+
+// Consumer thread: take until every producer's values have been seen, checking per-producer order
+void* take_worker(void* arg){
+  take_args_t *args = (take_args_t*) arg;
+  int last[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++) last[i] = -1;
+  args->in_order = true;
+  while(__atomic_load_n(&total_taken, __ATOMIC_RELAXED) < NUM_THREADS * PUTS_PER_THREAD){
+    int val = seg_queue_take(args->q);
+    if(val == -1) continue;
+    __atomic_fetch_add(&total_taken, 1, __ATOMIC_RELAXED);
+    int producer = val / PUTS_PER_THREAD;
+    if(val % PUTS_PER_THREAD <= last[producer]) args->in_order = false;
+    last[producer] = val % PUTS_PER_THREAD;
+    args->taken[producer]++;
+  }
+  pthread_exit(0);
+}
+
+// Invariants 1-3 with concurrent producers and consumers across many segments
+TEST(SegQueueTest, ConcurrentInvariants) {
+  my_seg_queue_t q;
+  seg_queue_init(&q);
+
+  put_args_t put_args[NUM_THREADS];
+  take_args_t take_args[NUM_THREADS];
+  pthread_t producers[NUM_THREADS], consumers[NUM_THREADS];
+  for(int i=0; i < NUM_THREADS; i++){
+    put_args[i].q = &q;
+    put_args[i].id = i;
+    take_args[i].q = &q;
+    memset(take_args[i].taken, 0, sizeof(take_args[i].taken));
+    if(pthread_create(&producers[i], NULL, put_worker, &put_args[i]) != 0) perror("Could not create thread");
+    if(pthread_create(&consumers[i], NULL, take_worker, &take_args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < NUM_THREADS; i++){ // Wait for threads to exit
+    if(pthread_join(producers[i], NULL) != 0) perror("Could not exit thread");
+    if(pthread_join(consumers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  for(int p=0; p < NUM_THREADS; p++){
+    int taken = 0;
+    for(int c=0; c < NUM_THREADS; c++) taken += take_args[c].taken[p];
+    ASSERT_EQ(PUTS_PER_THREAD, taken); // Every value taken exactly once
+  }
+  for(int c=0; c < NUM_THREADS; c++){
+    ASSERT_TRUE(take_args[c].in_order);
+  }
+  ASSERT_TRUE(seg_queue_empty(&q));
+
+  // Clean up
+  seg_queue_destroy(&q);
+}
+
+// FIFO order across segment boundaries
+TEST(SegQueueTest, SpansSegments) {
+  my_seg_queue_t q;
+  seg_queue_init(&q);
+
+  for(int i=0; i < SEG_SIZE * 3 + 7; i++){
+    seg_queue_put(&q, i);
+  }
+  for(int i=0; i < SEG_SIZE * 3 + 7; i++){
+    ASSERT_EQ(i, seg_queue_take(&q));
+  }
+  ASSERT_EQ(-1, seg_queue_take(&q));
+  ASSERT_TRUE(seg_queue_empty(&q));
+
+  // The queue keeps working after its segments have been retired
+  seg_queue_put(&q, 42);
+  ASSERT_FALSE(seg_queue_empty(&q));
+  ASSERT_EQ(42, seg_queue_take(&q));
+
+  // Clean up
+  seg_queue_destroy(&q);
+}
+
+// Basic queue functionality
+TEST(SegQueueTest, BasicSegQueueOps) {
+  my_seg_queue_t q;
+  seg_queue_init(&q);
+
+  // Make sure the queue is empty
+  ASSERT_TRUE(seg_queue_empty(&q));
+  ASSERT_EQ(-1, seg_queue_take(&q));
+
+  // Add some items to the queue
+  seg_queue_put(&q, 1);
+  seg_queue_put(&q, 2);
+  seg_queue_put(&q, 3);
+  ASSERT_FALSE(seg_queue_empty(&q));
+
+  // Take the values from the queue and check them
+  ASSERT_EQ(1, seg_queue_take(&q));
+  ASSERT_EQ(2, seg_queue_take(&q));
+  ASSERT_EQ(3, seg_queue_take(&q));
+  ASSERT_TRUE(seg_queue_empty(&q));
+
+  // Clean up
+  seg_queue_destroy(&q);
+}
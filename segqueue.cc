@@ -0,0 +1,132 @@
+#include "segqueue.hh"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include "epoch.hh"
+
+// Segmented queue implementation: a linked list of segments, each an array of SEG_SIZE slots.
+// Producers claim a slot with one fetch-and-add on the tail segment's enq index and write it
+// in place; consumers claim slots in order by advancing deq. Values therefore sit contiguously
+// in memory and a node is allocated once per SEG_SIZE puts instead of once per put. A segment
+// is retired as a whole once consumers have moved past it; epochs keep it allocated until no
+// producer or consumer can still be looking at it.
+
+// Allocate an empty segment
+static segment_t* segment_new(){
+  segment_t *seg = (segment_t*) aligned_alloc(CACHE_LINE, sizeof(segment_t));
+  if(seg == NULL) perror("Could not allocate space");
+  seg->enq = 0;
+  seg->deq = 0;
+  seg->next = NULL;
+  for(int i=0; i<SEG_SIZE; i++){
+    seg->slots[i].full = 0;
+  }
+  return seg;
+}
+
+// Free a retired segment
+static void segment_free(void* seg){
+  free(seg);
+}
+
+// Initialize a segmented queue
+void seg_queue_init(my_seg_queue_t* queue) {
+  segment_t *seg = segment_new();
+  queue->head = seg;
+  queue->tail = seg;
+}
+
+// Destroy a segmented queue
+void seg_queue_destroy(my_seg_queue_t* queue) {
+  segment_t *seg = queue->head;
+  while(seg != NULL){ // free all segments sequentially
+    segment_t *next = seg->next;
+    free(seg);
+    seg = next;
+  }
+  queue->head = NULL;
+  queue->tail = NULL;
+}
+
+// Link a new segment after a full one and move the tail past it
+static void seg_queue_extend(my_seg_queue_t* queue, segment_t* seg){
+  segment_t *next = __atomic_load_n(&seg->next, __ATOMIC_ACQUIRE);
+  if(next == NULL){
+    segment_t *fresh = segment_new();
+    if(__atomic_compare_exchange_n(&seg->next, &next, fresh, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+      next = fresh;
+    } else {
+      free(fresh); // Another producer linked one first; ours was never visible
+    }
+  }
+  __atomic_compare_exchange_n(&queue->tail, &seg, next, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+// Put an element at the end of a segmented queue
+void seg_queue_put(my_seg_queue_t* queue, int element) {
+  epoch_enter();
+  while(true){
+    segment_t *seg = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    long i = __atomic_fetch_add(&seg->enq, 1, __ATOMIC_ACQ_REL);
+    if(i < SEG_SIZE){
+      seg->slots[i].data = element;
+      __atomic_store_n(&seg->slots[i].full, 1, __ATOMIC_RELEASE);
+      break;
+    }
+    seg_queue_extend(queue, seg); // Segment is full
+  }
+  epoch_exit();
+}
+
+// Check if a segmented queue is empty
+bool seg_queue_empty(my_seg_queue_t* queue) {
+  epoch_enter();
+  segment_t *seg = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+  long d = __atomic_load_n(&seg->deq, __ATOMIC_ACQUIRE);
+  bool empty = d >= SEG_SIZE ? __atomic_load_n(&seg->next, __ATOMIC_ACQUIRE) == NULL
+                             : d >= __atomic_load_n(&seg->enq, __ATOMIC_ACQUIRE);
+  epoch_exit();
+  return empty;
+}
+
+// Take an element off the front of a segmented queue, or return -1 if it is empty
+int seg_queue_take(my_seg_queue_t* queue) {
+  epoch_enter();
+  while(true){
+    segment_t *seg = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    long d = __atomic_load_n(&seg->deq, __ATOMIC_ACQUIRE);
+    if(d >= SEG_SIZE){ // Segment used up: move the head to the next one
+      segment_t *next = __atomic_load_n(&seg->next, __ATOMIC_ACQUIRE);
+      if(next == NULL) break; // Nothing has been put past this segment
+      if(__atomic_compare_exchange_n(&queue->head, &seg, next, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+        // The tail may still lag on this segment; move it on so nothing can reach it, then retire
+        segment_t *old = seg;
+        __atomic_compare_exchange_n(&queue->tail, &old, next, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        epoch_retire(seg, segment_free);
+      }
+      continue;
+    }
+    if(d >= __atomic_load_n(&seg->enq, __ATOMIC_ACQUIRE)) break; // No producer has claimed slot d
+    if(!__atomic_compare_exchange_n(&seg->deq, &d, d + 1, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)){
+      continue; // Another consumer claimed slot d
+    }
+    // Slot d is ours. Its producer has claimed it and is at most a few instructions from filling it.
+    for(int spins = 0; !__atomic_load_n(&seg->slots[d].full, __ATOMIC_ACQUIRE); spins++){
+      if(spins < LOCK_SPINS){
+        cpu_relax();
+      } else {
+        sched_yield();
+      }
+    }
+    int val = seg->slots[d].data;
+    epoch_exit();
+    return val;
+  }
+  epoch_exit();
+  return -1;
+}
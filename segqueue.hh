@@ -0,0 +1,42 @@
+#ifndef SEGQUEUE_H
+#define SEGQUEUE_H
+
+#include <stdbool.h>
+
+#include "lock.hh"
+
+#define SEG_SIZE 1024 // Values per segment
+
+typedef struct seg_slot {
+  int data;
+  int full; // Set once data has been written
+} seg_slot_t;
+
+typedef struct segment {
+  long enq __attribute__((aligned(CACHE_LINE))); // Next slot for producers, claimed by fetch-and-add
+  long deq __attribute__((aligned(CACHE_LINE))); // Next slot for consumers
+  struct segment *next;
+  seg_slot_t slots[SEG_SIZE] __attribute__((aligned(CACHE_LINE)));
+} segment_t;
+
+typedef struct my_seg_queue {
+  segment_t *head __attribute__((aligned(CACHE_LINE))); // Oldest segment, advanced by consumers
+  segment_t *tail __attribute__((aligned(CACHE_LINE))); // Newest segment, advanced by producers
+} my_seg_queue_t;
+
+// Initialize a segmented queue
+void seg_queue_init(my_seg_queue_t* queue);
+
+// Destroy a segmented queue
+void seg_queue_destroy(my_seg_queue_t* queue);
+
+// Put an element at the end of a segmented queue
+void seg_queue_put(my_seg_queue_t* queue, int element);
+
+// Check if a segmented queue is empty
+bool seg_queue_empty(my_seg_queue_t* queue);
+
+// Take an element off the front of a segmented queue, or return -1 if it is empty
+int seg_queue_take(my_seg_queue_t* queue);
+
+#endif
@@ -0,0 +1,272 @@
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "shmqueue.hh"
+
+#define NUM_PRODUCERS 4
+#define NUM_CONSUMERS 2
+#define PUTS_PER_PRODUCER 20000
+#define CAPACITY 16
+
+/****** Shared Queue Invariants ******/
+
+// The invariants of my_queue_t hold across processes that map the same shared queue, plus:
+
+// Invariant 1
+// Every record is taken exactly once, in the order its slot was reserved, whichever process
+// put or took it.
+
+// Invariant 2
+// A record is read in place where it was built: a consumer sees the bytes the producer wrote
+// through its own mapping, at whatever address that process mapped the queue.
+
+// Invariant 3
+// A process that dies holding the lock, a reserved slot or an acquired slot does not stop the
+// others: the slot is reclaimed and the records behind it are still delivered.
+
+/****** Begin Tests ******/
+
+// Helper for tests: a shared memory name unique to this run
+void queue_name(char* name, size_t size, const char* test) {
+  snprintf(name, size, "/shmqueue-tests-%d-%s", (int) getpid(), test);
+}
+
+// Helper for tests: wait for a child process and get its exit code, or -1 if it was killed
+int reap(pid_t pid) {
+  int status;
+  if(waitpid(pid, &status, 0) == -1) perror("Could not wait for child");
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+typedef struct consumer {
+  long taken;
+  bool in_order;
+} consumer_t;
+
+// Producer process for tests: put this producer's elements in sequence
+void produce(const char* name, int id) {
+  my_shm_queue_t q;
+  if(!shm_queue_open(&q, name)) _exit(1);
+  for(int i=0; i < PUTS_PER_PRODUCER; i++) {
+    shm_queue_put(&q, id * PUTS_PER_PRODUCER + i);
+  }
+  shm_queue_close(&q);
+  _exit(0);
+}
+
+// Consumer process for tests: take until a -1, checking per-producer order (invariant 1)
+void consume(const char* name, consumer_t* result) {
+  my_shm_queue_t q;
+  if(!shm_queue_open(&q, name)) _exit(1);
+  int last[NUM_PRODUCERS];
+  for(int p=0; p < NUM_PRODUCERS; p++) last[p] = -1;
+  for(;;) {
+    int element = shm_queue_take(&q);
+    if(element == -1) break;
+    int producer = element / PUTS_PER_PRODUCER, seq = element % PUTS_PER_PRODUCER;
+    if(seq <= last[producer]) result->in_order = false;
+    last[producer] = seq;
+    result->taken++;
+  }
+  shm_queue_close(&q);
+  _exit(0);
+}
+
+// A test of invariant 1: producer and consumer processes share a small ring
+TEST(ShmQueueTest, Invariant1) {
+  char name[64];
+  queue_name(name, sizeof(name), "order");
+  my_shm_queue_t q;
+  ASSERT_TRUE(shm_queue_create(&q, name, CAPACITY, sizeof(int)));
+  consumer_t *results = (consumer_t*) mmap(NULL, NUM_CONSUMERS * sizeof(consumer_t), PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(MAP_FAILED, (void*) results);
+
+  pid_t consumers[NUM_CONSUMERS], producers[NUM_PRODUCERS];
+  for(int i=0; i < NUM_CONSUMERS; i++) {
+    results[i].taken = 0;
+    results[i].in_order = true;
+    if((consumers[i] = fork()) == 0) consume(name, &results[i]);
+  }
+  for(int i=0; i < NUM_PRODUCERS; i++) {
+    if((producers[i] = fork()) == 0) produce(name, i);
+  }
+  for(int i=0; i < NUM_PRODUCERS; i++) {
+    ASSERT_EQ(0, reap(producers[i]));
+  }
+  for(int i=0; i < NUM_CONSUMERS; i++) {
+    shm_queue_put(&q, -1); // One stop element per consumer
+  }
+
+  long taken = 0;
+  for(int i=0; i < NUM_CONSUMERS; i++) {
+    ASSERT_EQ(0, reap(consumers[i]));
+    ASSERT_TRUE(results[i].in_order);
+    taken += results[i].taken;
+  }
+  ASSERT_EQ(NUM_PRODUCERS * PUTS_PER_PRODUCER, taken);
+  ASSERT_EQ(0, shm_queue_size(&q));
+  ASSERT_EQ(0, shm_queue_recovered(&q));
+  munmap(results, NUM_CONSUMERS * sizeof(consumer_t));
+  shm_queue_destroy(&q, name);
+}
+
+typedef struct message {
+  int id;
+  char text[40];
+} message_t;
+
+// A test of invariant 2: records built in one mapping are read in place through another
+TEST(ShmQueueTest, Invariant2) {
+  char name[64];
+  queue_name(name, sizeof(name), "inplace");
+  my_shm_queue_t q1, q2;
+  ASSERT_TRUE(shm_queue_create(&q1, name, 2, sizeof(message_t)));
+  ASSERT_TRUE(shm_queue_open(&q2, name));
+  ASSERT_NE(q1.header, q2.header); // Two mappings of the same region
+
+  int length;
+  ASSERT_EQ(NULL, shm_queue_try_acquire(&q2, &length));
+  message_t *out = (message_t*) shm_queue_reserve(&q1);
+  ASSERT_TRUE((char*) out > (char*) q1.header && (char*) out < (char*) q1.header + q1.size);
+  out->id = 7;
+  strcpy(out->text, "built in place");
+  ASSERT_EQ(NULL, shm_queue_try_acquire(&q2, &length)); // Not committed yet
+  ASSERT_TRUE(shm_queue_commit(&q1, out, sizeof(message_t)));
+
+  const message_t *in = (const message_t*) shm_queue_acquire(&q2, &length);
+  ASSERT_TRUE((char*) in > (char*) q2.header && (char*) in < (char*) q2.header + q2.size);
+  ASSERT_EQ((int) sizeof(message_t), length);
+  ASSERT_EQ(7, in->id);
+  ASSERT_STREQ("built in place", in->text);
+  shm_queue_release(&q2, in);
+
+  // The same from a child process
+  pid_t child = fork();
+  if(child == 0) {
+    my_shm_queue_t q;
+    if(!shm_queue_open(&q, name)) _exit(1);
+    message_t *m = (message_t*) shm_queue_reserve(&q);
+    m->id = 8;
+    strcpy(m->text, "from a child");
+    shm_queue_commit(&q, m, sizeof(message_t));
+    shm_queue_close(&q);
+    _exit(0);
+  }
+  ASSERT_EQ(0, reap(child));
+  in = (const message_t*) shm_queue_acquire(&q1, &length);
+  ASSERT_EQ(8, in->id);
+  ASSERT_STREQ("from a child", in->text);
+  shm_queue_release(&q1, in);
+  ASSERT_EQ(0, shm_queue_size(&q1));
+  shm_queue_close(&q2);
+  shm_queue_destroy(&q1, name);
+}
+
+// Helper for tests: run step in a child process that kills itself once step returns, and
+// wait until it has reserved or acquired what it holds
+pid_t die_holding(const char* name, void (*step)(my_shm_queue_t* q)) {
+  int ready[2];
+  if(pipe(ready) == -1) perror("Could not create pipe");
+  pid_t child = fork();
+  if(child == 0) {
+    my_shm_queue_t q;
+    if(!shm_queue_open(&q, name)) _exit(1);
+    step(&q);
+    char c = 0;
+    if(write(ready[1], &c, 1) != 1) _exit(1);
+    kill(getpid(), SIGKILL);
+  }
+  char c;
+  if(read(ready[0], &c, 1) != 1) perror("Could not read pipe");
+  close(ready[0]);
+  close(ready[1]);
+  return child;
+}
+
+// Steps for tests: hold a reserved slot, an acquired slot, or the lock
+void hold_reserved(my_shm_queue_t* q) { shm_queue_reserve(q); }
+void hold_acquired(my_shm_queue_t* q) { int length; shm_queue_acquire(q, &length); }
+void hold_lock(my_shm_queue_t* q) { pthread_mutex_lock(&q->header->lock); }
+
+// Reaper thread for tests: wait for a child while the test thread is blocked
+void* reap_worker(void* arg) {
+  reap(*(pid_t*) arg);
+  pthread_exit(0);
+}
+
+// A test of invariant 3: peers that die holding slots or the lock are recovered from
+TEST(ShmQueueTest, Invariant3) {
+  char name[64];
+  queue_name(name, sizeof(name), "recover");
+  my_shm_queue_t q;
+  ASSERT_TRUE(shm_queue_create(&q, name, 2, sizeof(int)));
+
+  // A producer dies before committing while a consumer is blocked behind its slot
+  pid_t child = die_holding(name, hold_reserved);
+  shm_queue_put(&q, 1);
+  pthread_t reaper;
+  if(pthread_create(&reaper, NULL, reap_worker, &child) != 0) perror("Could not create thread");
+  ASSERT_EQ(1, shm_queue_take(&q)); // Waits until the producer is gone, then skips its slot
+  if(pthread_join(reaper, NULL) != 0) perror("Could not exit thread");
+  ASSERT_EQ(1, shm_queue_recovered(&q));
+
+  // A consumer dies before releasing; producers get its slot back once the ring wraps to it
+  shm_queue_put(&q, 2);
+  child = die_holding(name, hold_acquired);
+  ASSERT_EQ(-1, reap(child));
+  shm_queue_put(&q, 3);
+  shm_queue_put(&q, 4);
+  ASSERT_EQ(2, shm_queue_recovered(&q));
+  ASSERT_EQ(3, shm_queue_take(&q));
+  ASSERT_EQ(4, shm_queue_take(&q));
+
+  // A process dies holding the lock
+  child = die_holding(name, hold_lock);
+  ASSERT_EQ(-1, reap(child));
+  shm_queue_put(&q, 5);
+  ASSERT_EQ(3, shm_queue_recovered(&q));
+  int element;
+  ASSERT_TRUE(shm_queue_poll(&q, &element));
+  ASSERT_EQ(5, element);
+  ASSERT_FALSE(shm_queue_poll(&q, &element));
+  shm_queue_destroy(&q, name);
+}
+
+// Queues that could not work are refused, both when created and when opened
+TEST(ShmQueueTest, BadArguments) {
+  char name[64];
+  queue_name(name, sizeof(name), "bad");
+  my_shm_queue_t q, q2;
+  ASSERT_FALSE(shm_queue_create(&q, name, 0, sizeof(int)));
+  ASSERT_FALSE(shm_queue_create(&q, name, -1, sizeof(int)));
+  ASSERT_FALSE(shm_queue_create(&q, name, 4, 2)); // Too small for shm_queue_put
+  ASSERT_FALSE(shm_queue_open(&q, name)); // Nothing was created
+
+  ASSERT_TRUE(shm_queue_create(&q, name, 4, sizeof(int)));
+  int fd = shm_open(name, O_RDWR, 0);
+  ASSERT_NE(-1, fd);
+  ASSERT_EQ(0, ftruncate(fd, q.size + 4096)); // No longer the size the header describes
+  close(fd);
+  ASSERT_FALSE(shm_queue_open(&q2, name));
+  shm_queue_destroy(&q, name);
+
+  // A record length outside [0, record_size] is refused and the slot stays reserved
+  ASSERT_TRUE(shm_queue_create(&q, name, 4, sizeof(int)));
+  int *record = (int*) shm_queue_reserve(&q);
+  ASSERT_FALSE(shm_queue_commit(&q, record, -1));
+  ASSERT_FALSE(shm_queue_commit(&q, record, sizeof(int) + 1));
+  int length;
+  ASSERT_EQ(NULL, shm_queue_try_acquire(&q, &length));
+  *record = 9;
+  ASSERT_TRUE(shm_queue_commit(&q, record, sizeof(int)));
+  ASSERT_EQ(record, shm_queue_try_acquire(&q, &length));
+  ASSERT_EQ((int) sizeof(int), length);
+  shm_queue_release(&q, record);
+  shm_queue_destroy(&q, name);
+}
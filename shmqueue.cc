@@ -0,0 +1,391 @@
+#include "shmqueue.hh"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Shared queue implementation: a bounded ring of fixed-size slots in one shared memory region,
+// guarded by a robust, process-shared mutex. Only the bookkeeping (reserving and publishing a
+// slot, taking and returning it) happens under the lock; records are written and read in place
+// outside it, so a message costs no copies and, when nobody waits, no system calls.
+// Slots in [head, tail) are WRITING or READY; slots outside it are FREE, or READING while a
+// consumer still holds a record it took. Each step under the lock changes a slot's state and
+// head or tail with release stores, so the compiler keeps them in order. A process killed
+// between the two leaves a slot that disagrees with its place in the ring, which shmq_repair
+// puts right when the next locker gets EOWNERDEAD. A process killed while holding a slot
+// outside the lock is found by the process waiting on that slot, which checks that the owner
+// is still alive every SHMQ_CHECK_MS. A dead process counts as dead once it has been reaped.
+
+// shmq_slot finds the slot for position pos of the ring
+static shmq_slot_t* shmq_slot(shmq_header_t* header, unsigned long pos){
+  return (shmq_slot_t*) ((char*) header + header->slots + (pos % header->capacity) * header->stride);
+}
+
+// shmq_record_slot finds the slot holding a record
+static shmq_slot_t* shmq_record_slot(const void* record){
+  return (shmq_slot_t*) ((char*) record - offsetof(shmq_slot_t, data));
+}
+
+// shmq_alive checks whether a process still exists
+static bool shmq_alive(pid_t pid){
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// shmq_repair undoes a step that a dead process left half done, by putting every slot back in a
+// state that matches its place in the ring. The caller holds the lock.
+static void shmq_repair(shmq_header_t* header){
+  for(unsigned long pos = header->head; pos < header->head + header->capacity; pos++){
+    shmq_slot_t *slot = shmq_slot(header, pos);
+    if(pos < header->tail){
+      // Died taking: the record is marked but head was not moved, so it was never read
+      if(slot->state == SHMQ_READING) slot->state = SHMQ_READY;
+    } else if(slot->state == SHMQ_WRITING || slot->state == SHMQ_READY){
+      // Died reserving, or skipping an abandoned slot, between the slot and tail or head
+      slot->state = SHMQ_FREE;
+    }
+  }
+  header->recovered++;
+}
+
+// shmq_check reports an error returned by a pthread call, making the lock usable again if its
+// last owner died holding it. Any other error means this process does not hold the lock, so
+// carrying on would corrupt the ring: it aborts.
+static void shmq_check(shmq_header_t* header, int rc, const char* message){
+  if(rc == EOWNERDEAD){
+    shmq_repair(header);
+    pthread_mutex_consistent(&header->lock);
+  } else if(rc != 0 && rc != ETIMEDOUT){
+    errno = rc;
+    perror(message);
+    abort();
+  }
+}
+
+// shmq_lock locks a shared queue
+static void shmq_lock(shmq_header_t* header){
+  shmq_check(header, pthread_mutex_lock(&header->lock), "Could not lock shared queue");
+}
+
+// shmq_unlock unlocks a shared queue
+static void shmq_unlock(shmq_header_t* header){
+  pthread_mutex_unlock(&header->lock);
+}
+
+// shmq_wait waits on a condition for at most SHMQ_CHECK_MS. A waiter killed inside
+// pthread_cond_timedwait can swallow a signal meant for a live one, so every wait is bounded.
+static void shmq_wait(shmq_header_t* header, pthread_cond_t* cond){
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_nsec += SHMQ_CHECK_MS * 1000000L;
+  if(deadline.tv_nsec >= 1000000000L){
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  shmq_check(header, pthread_cond_timedwait(cond, &header->lock, &deadline), "Could not wait on shared queue");
+}
+
+// shmq_size gets the bytes a queue's region needs, storing where the slots start and how far
+// apart they are
+static size_t shmq_size(int capacity, int record_size, size_t* slots, size_t* stride){
+  *stride = (sizeof(shmq_slot_t) + record_size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  *slots = (sizeof(shmq_header_t) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  return *slots + (size_t) capacity * *stride;
+}
+
+// shmq_map maps an open shared memory object of size bytes
+static shmq_header_t* shmq_map(int fd, size_t size){
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd); // The mapping keeps the object open
+  if(base == MAP_FAILED){
+    perror("Could not map shared queue");
+    return NULL;
+  }
+  return (shmq_header_t*) base;
+}
+
+// Create a shared queue of capacity slots of record_size bytes in a new POSIX shared memory
+// object called name (which must start with '/'), and map it. Fails if name already exists,
+// or if capacity is not positive or record_size cannot hold an int. Returns true on success.
+bool shm_queue_create(my_shm_queue_t* queue, const char* name, int capacity, int record_size) {
+  if(capacity <= 0 || record_size < (int) sizeof(int) || record_size > SHMQ_MAX_RECORD){
+    fprintf(stderr, "Shared queue %s: bad capacity %d or record size %d\n", name, capacity, record_size);
+    return false;
+  }
+  size_t slots, stride;
+  size_t size = shmq_size(capacity, record_size, &slots, &stride);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fd == -1){
+    perror("Could not create shared queue");
+    return false;
+  }
+  if(ftruncate(fd, size) == -1){
+    perror("Could not size shared queue");
+    close(fd);
+    shm_unlink(name);
+    return false;
+  }
+  shmq_header_t *header = shmq_map(fd, size);
+  if(header == NULL){
+    shm_unlink(name);
+    return false;
+  }
+
+  header->capacity = capacity;
+  header->record_size = record_size;
+  header->stride = stride;
+  header->slots = slots;
+  header->head = header->tail = 0;
+  header->recovered = 0;
+  for(int i=0; i < capacity; i++){
+    shmq_slot_t *slot = shmq_slot(header, i);
+    slot->state = SHMQ_FREE;
+    slot->owner = 0;
+    slot->length = 0;
+  }
+
+  pthread_mutexattr_t mattr;
+  pthread_mutexattr_init(&mattr);
+  pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&header->lock, &mattr);
+  pthread_mutexattr_destroy(&mattr);
+
+  pthread_condattr_t cattr;
+  pthread_condattr_init(&cattr);
+  pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+  pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+  pthread_cond_init(&header->not_empty, &cattr);
+  pthread_cond_init(&header->not_full, &cattr);
+  pthread_condattr_destroy(&cattr);
+
+  __atomic_store_n(&header->magic, SHMQ_MAGIC, __ATOMIC_RELEASE);
+  queue->header = header;
+  queue->size = size;
+  return true;
+}
+
+// Map a shared queue that another process created. Fails if the region's size does not match
+// its header. Returns true on success.
+bool shm_queue_open(my_shm_queue_t* queue, const char* name) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if(fd == -1){
+    perror("Could not open shared queue");
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(shmq_header_t)){
+    fprintf(stderr, "Shared queue %s is not ready\n", name);
+    close(fd);
+    return false;
+  }
+  shmq_header_t *header = shmq_map(fd, st.st_size);
+  if(header == NULL) return false;
+  if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHMQ_MAGIC){
+    fprintf(stderr, "Shared queue %s is not ready\n", name);
+    munmap(header, st.st_size);
+    return false;
+  }
+  size_t slots, stride;
+  if(header->capacity <= 0 || header->record_size < (int) sizeof(int) || header->record_size > SHMQ_MAX_RECORD ||
+     shmq_size(header->capacity, header->record_size, &slots, &stride) != (size_t) st.st_size ||
+     header->slots != slots || header->stride != stride){
+    fprintf(stderr, "Shared queue %s does not match its size\n", name);
+    munmap(header, st.st_size);
+    return false;
+  }
+  queue->header = header;
+  queue->size = st.st_size;
+  return true;
+}
+
+// Unmap a shared queue in this process. Records reserved or acquired here must be finished first.
+void shm_queue_close(my_shm_queue_t* queue) {
+  munmap(queue->header, queue->size);
+  queue->header = NULL;
+}
+
+// Destroy a shared queue once no process is using it: unmap it and remove name
+void shm_queue_destroy(my_shm_queue_t* queue, const char* name) {
+  // The lock and conditions hold no kernel resources, and pthread_cond_destroy would wait
+  // forever for a waiter that was killed, so they are simply unmapped
+  shm_queue_close(queue);
+  if(shm_unlink(name) == -1) perror("Could not remove shared queue");
+}
+
+// shmq_reserve_locked waits for the slot at tail and claims it for writing. The caller holds the lock.
+static shmq_slot_t* shmq_reserve_locked(shmq_header_t* header){
+  shmq_slot_t *slot;
+  for(;;){
+    if(header->tail - header->head < (unsigned long) header->capacity){
+      slot = shmq_slot(header, header->tail);
+      if(slot->state == SHMQ_FREE) break;
+      if(slot->state == SHMQ_READING && !shmq_alive(slot->owner)){
+        // The consumer died holding it; its record is lost
+        slot->state = SHMQ_FREE;
+        header->recovered++;
+        break;
+      }
+    }
+    shmq_wait(header, &header->not_full);
+  }
+  slot->owner = getpid();
+  __atomic_store_n(&slot->state, SHMQ_WRITING, __ATOMIC_RELAXED);
+  __atomic_store_n(&header->tail, header->tail + 1, __ATOMIC_RELEASE);
+  // Pass the wakeup on if the next producer can go too
+  if(header->tail - header->head < (unsigned long) header->capacity &&
+     shmq_slot(header, header->tail)->state == SHMQ_FREE){
+    pthread_cond_signal(&header->not_full);
+  }
+  return slot;
+}
+
+// shmq_commit_locked publishes a reserved slot. The caller holds the lock.
+static void shmq_commit_locked(shmq_header_t* header, shmq_slot_t* slot, int length){
+  slot->length = length;
+  __atomic_store_n(&slot->state, SHMQ_READY, __ATOMIC_RELEASE);
+  if(slot == shmq_slot(header, header->head)) pthread_cond_signal(&header->not_empty);
+}
+
+// shmq_acquire_locked waits for the record at head, if wait is set, and claims it for reading.
+// Returns NULL if wait is not set and there is none. The caller holds the lock.
+static shmq_slot_t* shmq_acquire_locked(shmq_header_t* header, bool wait){
+  shmq_slot_t *slot;
+  for(;;){
+    if(header->head != header->tail){
+      slot = shmq_slot(header, header->head);
+      if(slot->state == SHMQ_READY) break;
+      if(slot->state == SHMQ_WRITING && !shmq_alive(slot->owner)){
+        // The producer died before committing; skip the half-written record
+        __atomic_store_n(&header->head, header->head + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&slot->state, SHMQ_FREE, __ATOMIC_RELEASE);
+        header->recovered++;
+        pthread_cond_signal(&header->not_full);
+        continue;
+      }
+    }
+    if(!wait) return NULL;
+    shmq_wait(header, &header->not_empty);
+  }
+  slot->owner = getpid();
+  __atomic_store_n(&slot->state, SHMQ_READING, __ATOMIC_RELAXED);
+  __atomic_store_n(&header->head, header->head + 1, __ATOMIC_RELEASE);
+  // Pass the wakeup on if the next record is ready too
+  if(header->head != header->tail && shmq_slot(header, header->head)->state == SHMQ_READY){
+    pthread_cond_signal(&header->not_empty);
+  }
+  return slot;
+}
+
+// shmq_release_locked returns an acquired slot to producers. The caller holds the lock.
+static void shmq_release_locked(shmq_header_t* header, shmq_slot_t* slot){
+  __atomic_store_n(&slot->state, SHMQ_FREE, __ATOMIC_RELEASE);
+  if(slot == shmq_slot(header, header->tail)) pthread_cond_signal(&header->not_full);
+}
+
+// Reserve the next slot, waiting while the ring is full. Returns a pointer to record_size bytes
+// in shared memory to build the record in place; hand it to shm_queue_commit when done.
+void* shm_queue_reserve(my_shm_queue_t* queue) {
+  shmq_lock(queue->header);
+  shmq_slot_t *slot = shmq_reserve_locked(queue->header);
+  shmq_unlock(queue->header);
+  return slot->data;
+}
+
+// Publish a reserved record of length bytes, which must be within [0, record_size]. Records are
+// taken in the order their slots were reserved, so a slow producer holds up later records until
+// it commits. Returns false, leaving the slot reserved, if length is out of range.
+bool shm_queue_commit(my_shm_queue_t* queue, void* record, int length) {
+  if(length < 0 || length > queue->header->record_size){
+    fprintf(stderr, "Shared queue: bad record length %d\n", length);
+    return false;
+  }
+  shmq_lock(queue->header);
+  shmq_commit_locked(queue->header, shmq_record_slot(record), length);
+  shmq_unlock(queue->header);
+  return true;
+}
+
+// Acquire the record at the front of a shared queue, waiting while it is empty. Returns a
+// pointer to the record in shared memory and stores its length; hand it to shm_queue_release
+// once done reading. The slot is not reused until then.
+const void* shm_queue_acquire(my_shm_queue_t* queue, int* length) {
+  shmq_lock(queue->header);
+  shmq_slot_t *slot = shmq_acquire_locked(queue->header, true);
+  shmq_unlock(queue->header);
+  *length = slot->length;
+  return slot->data;
+}
+
+// Acquire the record at the front of a shared queue without waiting.
+// Returns NULL if there is no committed record at the front.
+const void* shm_queue_try_acquire(my_shm_queue_t* queue, int* length) {
+  shmq_lock(queue->header);
+  shmq_slot_t *slot = shmq_acquire_locked(queue->header, false);
+  shmq_unlock(queue->header);
+  if(slot == NULL) return NULL;
+  *length = slot->length;
+  return slot->data;
+}
+
+// Return an acquired record's slot to producers
+void shm_queue_release(my_shm_queue_t* queue, const void* record) {
+  shmq_lock(queue->header);
+  shmq_release_locked(queue->header, shmq_record_slot(record));
+  shmq_unlock(queue->header);
+}
+
+// Put an element at the end of a shared queue, waiting while it is full
+void shm_queue_put(my_shm_queue_t* queue, int element) {
+  shmq_lock(queue->header);
+  shmq_slot_t *slot = shmq_reserve_locked(queue->header);
+  memcpy(slot->data, &element, sizeof(element));
+  shmq_commit_locked(queue->header, slot, sizeof(element));
+  shmq_unlock(queue->header);
+}
+
+// Take an element off the front of a shared queue, waiting while it is empty
+int shm_queue_take(my_shm_queue_t* queue) {
+  int element;
+  shmq_lock(queue->header);
+  shmq_slot_t *slot = shmq_acquire_locked(queue->header, true);
+  memcpy(&element, slot->data, sizeof(element));
+  shmq_release_locked(queue->header, slot);
+  shmq_unlock(queue->header);
+  return element;
+}
+
+// Take an element off the front of a shared queue without waiting.
+// Returns true and stores the element if one was taken, false if none was ready.
+bool shm_queue_poll(my_shm_queue_t* queue, int* element) {
+  shmq_lock(queue->header);
+  shmq_slot_t *slot = shmq_acquire_locked(queue->header, false);
+  if(slot != NULL){
+    memcpy(element, slot->data, sizeof(*element));
+    shmq_release_locked(queue->header, slot);
+  }
+  shmq_unlock(queue->header);
+  return slot != NULL;
+}
+
+// Get the number of slots reserved and not yet taken
+long shm_queue_size(my_shm_queue_t* queue) {
+  shmq_lock(queue->header);
+  long size = queue->header->tail - queue->header->head;
+  shmq_unlock(queue->header);
+  return size;
+}
+
+// Get the number of slots and locks reclaimed from processes that died holding them
+long shm_queue_recovered(my_shm_queue_t* queue) {
+  shmq_lock(queue->header);
+  long recovered = queue->header->recovered;
+  shmq_unlock(queue->header);
+  return recovered;
+}
@@ -0,0 +1,100 @@
+#ifndef SHMQUEUE_H
+#define SHMQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "lock.hh"
+
+#define SHMQ_MAGIC 0x53484d51 // Set last by shm_queue_create, once the region is usable
+#define SHMQ_CHECK_MS 10      // How often a blocked call checks whether the peer it waits on died
+#define SHMQ_MAX_RECORD (1 << 24) // Largest record size a queue may be created with
+
+// Slot states
+enum { SHMQ_FREE, SHMQ_WRITING, SHMQ_READY, SHMQ_READING };
+
+// One slot of the ring. The record follows the header in the same cache lines.
+typedef struct shmq_slot {
+  int state;
+  pid_t owner;  // Process that reserved or acquired the slot
+  int length;   // Bytes committed
+  int pad;
+  char data[];
+} shmq_slot_t;
+
+// The start of the shared region. Everything in the region is found by offset from here, so
+// each process may map it at a different address.
+typedef struct shmq_header {
+  unsigned int magic;
+  int capacity;           // Slots in the ring
+  int record_size;        // Largest record a slot holds
+  size_t stride;          // Bytes from one slot to the next
+  size_t slots;           // Offset of slot 0 from the start of the region
+  pthread_mutex_t lock;   // Robust and process-shared; guards everything below
+  pthread_cond_t not_empty, not_full;
+  unsigned long head;     // Slots taken so far; the slot at head % capacity is next to take
+  unsigned long tail;     // Slots reserved so far
+  long recovered;         // Slots and locks reclaimed from processes that died holding them
+} __attribute__((aligned(CACHE_LINE))) shmq_header_t;
+
+// One process's handle on a shared queue
+typedef struct my_shm_queue {
+  shmq_header_t *header; // Where this process mapped the region
+  size_t size;           // Bytes mapped
+} my_shm_queue_t;
+
+// Create a shared queue of capacity slots of record_size bytes in a new POSIX shared memory
+// object called name (which must start with '/'), and map it. Fails if name already exists,
+// or if capacity is not positive or record_size cannot hold an int. Returns true on success.
+bool shm_queue_create(my_shm_queue_t* queue, const char* name, int capacity, int record_size);
+
+// Map a shared queue that another process created. Fails if the region's size does not match
+// its header. Returns true on success.
+bool shm_queue_open(my_shm_queue_t* queue, const char* name);
+
+// Unmap a shared queue in this process. Records reserved or acquired here must be finished first.
+void shm_queue_close(my_shm_queue_t* queue);
+
+// Destroy a shared queue once no process is using it: unmap it and remove name
+void shm_queue_destroy(my_shm_queue_t* queue, const char* name);
+
+// Reserve the next slot, waiting while the ring is full. Returns a pointer to record_size bytes
+// in shared memory to build the record in place; hand it to shm_queue_commit when done.
+void* shm_queue_reserve(my_shm_queue_t* queue);
+
+// Publish a reserved record of length bytes, which must be within [0, record_size]. Records are
+// taken in the order their slots were reserved, so a slow producer holds up later records until
+// it commits. Returns false, leaving the slot reserved, if length is out of range.
+bool shm_queue_commit(my_shm_queue_t* queue, void* record, int length);
+
+// Acquire the record at the front of a shared queue, waiting while it is empty. Returns a
+// pointer to the record in shared memory and stores its length; hand it to shm_queue_release
+// once done reading. The slot is not reused until then.
+const void* shm_queue_acquire(my_shm_queue_t* queue, int* length);
+
+// Acquire the record at the front of a shared queue without waiting.
+// Returns NULL if there is no committed record at the front.
+const void* shm_queue_try_acquire(my_shm_queue_t* queue, int* length);
+
+// Return an acquired record's slot to producers
+void shm_queue_release(my_shm_queue_t* queue, const void* record);
+
+// Put an element at the end of a shared queue, waiting while it is full
+void shm_queue_put(my_shm_queue_t* queue, int element);
+
+// Take an element off the front of a shared queue, waiting while it is empty
+int shm_queue_take(my_shm_queue_t* queue);
+
+// Take an element off the front of a shared queue without waiting.
+// Returns true and stores the element if one was taken, false if none was ready.
+bool shm_queue_poll(my_shm_queue_t* queue, int* element);
+
+// Get the number of slots reserved and not yet taken
+long shm_queue_size(my_shm_queue_t* queue);
+
+// Get the number of slots and locks reclaimed from processes that died holding them
+long shm_queue_recovered(my_shm_queue_t* queue);
+
+#endif
@@ -1,8 +1,11 @@
 #include <gtest/gtest.h>
 
 #include "stack.hh"
+#include "lincheck.hh"
+#include "epoch.hh"
 #include "stdlib.h"
 #include "time.h"
+#include "limits.h"
 
 /****** Stack Invariants ******/
 
@@ -15,6 +18,9 @@
 // Invariant 3
 // If a thread pushes value A and then pushes value B, and no other thread pushes these specific values, A must not be popped from the stack before popping B.
 
+// Invariant 4
+// Every history of concurrent pushes and pops is linearizable: each operation appears to take effect at one instant between its call and its return, in an order a sequential stack would accept.
+
 /****** Begin Tests ******/
 
 
@@ -166,3 +172,308 @@ TEST(StackTest, EmptyStack) {
   // Clean up
   stack_destroy(&s);
 }
+
+// Non-blocking push/pop
+TEST(StackTest, TryStackOps) {
+  my_stack_t s;
+  stack_init(&s);
+  int val = 0;
+
+  // Nothing to pop from an empty stack
+  ASSERT_FALSE(stack_try_pop(&s, &val));
+
+  // Uncontended pushes and pops always succeed
+  ASSERT_TRUE(stack_try_push(&s, 1));
+  ASSERT_TRUE(stack_try_push(&s, 2));
+  ASSERT_TRUE(stack_try_pop(&s, &val));
+  ASSERT_EQ(2, val);
+
+  // A held lock makes both fail fast
+  lock_acquire(&s.lock);
+  ASSERT_FALSE(stack_try_push(&s, 3));
+  ASSERT_FALSE(stack_try_pop(&s, &val));
+  lock_release(&s.lock);
+
+  ASSERT_EQ(1, stack_pop(&s));
+  ASSERT_TRUE(stack_empty(&s));
+
+  // Clean up
+  stack_destroy(&s);
+}
+
+#define FC_THREADS 8
+#define FC_PUSHES 10000
+
+// Worker thread for flat-combining test: push FC_PUSHES copies of val
+void* push_many_worker(void* arg){
+  push_args_t *args = (push_args_t*) arg;
+  for(int i=0; i < FC_PUSHES; i++){
+    stack_push(args->s, args->val);
+  }
+  pthread_exit(0);
+}
+
+// Invariant 1 in flat-combining mode: every concurrently published push is applied exactly once
+TEST(StackTest, CombiningInvariant1) {
+  my_stack_t s;
+  stack_init_combining(&s);
+
+  push_args_t args[FC_THREADS];
+  pthread_t workers[FC_THREADS];
+  for(int i=0; i < FC_THREADS; i++){
+    args[i].s = &s;
+    args[i].val = i;
+    if(pthread_create(&workers[i], NULL, push_many_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < FC_THREADS; i++){ // Wait for threads to exit
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  int counts[FC_THREADS] = {0};
+  int val;
+  while((val = stack_pop(&s)) != -1){
+    ASSERT_TRUE(val >= 0 && val < FC_THREADS); // Invariant 2: only pushed values come back
+    counts[val]++;
+  }
+  for(int i=0; i < FC_THREADS; i++){
+    ASSERT_EQ(FC_PUSHES, counts[i]);
+  }
+
+  // Clean up
+  stack_destroy(&s);
+}
+
+// Array-backed storage: growth past the initial capacity and shrinking back down
+TEST(StackTest, ArrayStackOps) {
+  my_stack_t s;
+  stack_init_array(&s, 4, true);
+  ASSERT_TRUE(stack_empty(&s));
+  ASSERT_EQ(-1, stack_pop(&s));
+
+  // Push well past the initial capacity
+  for(int i=0; i < 1000; i++){
+    stack_push(&s, i);
+  }
+  ASSERT_FALSE(stack_empty(&s));
+  ASSERT_GE(s.capacity, 1000);
+
+  // Elements still come off in LIFO order, and the array shrinks as it empties
+  for(int i=999; i >= 0; i--){
+    ASSERT_EQ(i, stack_pop(&s));
+  }
+  ASSERT_TRUE(stack_empty(&s));
+  ASSERT_EQ(4, s.capacity);
+
+  // Clean up
+  stack_destroy(&s);
+}
+
+// Bulk push and pop keep LIFO order in both storage modes
+TEST(StackTest, BulkStackOps) {
+  my_stack_t stacks[2];
+  stack_init(&stacks[0]);
+  stack_init_array(&stacks[1], 2, false);
+  int in[100], out[100];
+  for(int i=0; i < 100; i++) in[i] = i;
+
+  for(int m=0; m < 2; m++){
+    my_stack_t *s = &stacks[m];
+    stack_push(s, -5);
+    stack_push_many(s, in, 100);
+    ASSERT_EQ(99, stack_pop(s)); // Last element pushed is on top
+    stack_push(s, 99);
+
+    // Popped elements come back in push order
+    ASSERT_EQ(60, stack_pop_many(s, out, 60));
+    for(int i=0; i < 60; i++){
+      ASSERT_EQ(40 + i, out[i]);
+    }
+
+    // Asking for more than is left returns what there is
+    ASSERT_EQ(41, stack_pop_many(s, out, 100));
+    ASSERT_EQ(-5, out[0]);
+    ASSERT_EQ(39, out[40]);
+    ASSERT_TRUE(stack_empty(s));
+    ASSERT_EQ(0, stack_pop_many(s, out, 10));
+
+    // Clean up
+    stack_destroy(s);
+  }
+}
+
+// An array-backed stack that cannot grow pushes nothing rather than writing past its array
+TEST(StackTest, ArrayCannotGrow) {
+  my_stack_t s;
+  stack_init_array(&s, 2, false);
+  stack_push(&s, 7);
+  stack_push_many(&s, NULL, INT_MAX); // Would overflow the int capacity; never read
+  ASSERT_EQ(7, stack_pop(&s));
+  ASSERT_TRUE(stack_empty(&s));
+
+  // Clean up
+  stack_destroy(&s);
+}
+
+// Invariant 1 for an array-backed stack under concurrent pushes
+TEST(StackTest, ArrayInvariant1) {
+  my_stack_t s;
+  stack_init_array(&s, 1, true);
+
+  push_args_t args[FC_THREADS];
+  pthread_t workers[FC_THREADS];
+  for(int i=0; i < FC_THREADS; i++){
+    args[i].s = &s;
+    args[i].val = i;
+    if(pthread_create(&workers[i], NULL, push_many_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  for(int i=0; i < FC_THREADS; i++){ // Wait for threads to exit
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+  }
+
+  int counts[FC_THREADS] = {0};
+  int val;
+  while((val = stack_pop(&s)) != -1){
+    counts[val]++;
+  }
+  for(int i=0; i < FC_THREADS; i++){
+    ASSERT_EQ(FC_PUSHES, counts[i]);
+  }
+
+  // Clean up
+  stack_destroy(&s);
+}
+
+#define REBUILDS 20
+
+static my_stack_t *live_stack; // Stack the churn workers currently use
+static int stop_churn;
+
+// Worker thread for the rebuild test: push and pop on whichever stack is live
+void* churn_worker(void* arg){
+  long bad = 0;
+  for(int i=0; !__atomic_load_n(&stop_churn, __ATOMIC_ACQUIRE); i++){
+    my_stack_t *s = __atomic_load_n(&live_stack, __ATOMIC_ACQUIRE);
+    stack_push(s, i % 100);
+    int val = stack_pop(s);
+    if(val < -1 || val >= 100) bad++; // Only pushed values, or -1 once destroyed
+  }
+  return (void*) bad;
+}
+
+// Stacks can be destroyed and replaced while other threads are still using them
+TEST(StackTest, OnlineRebuild) {
+  my_stack_t stacks[REBUILDS + 1];
+  stack_init(&stacks[0]);
+  live_stack = &stacks[0];
+  stop_churn = 0;
+
+  pthread_t workers[FC_THREADS];
+  for(int i=0; i < FC_THREADS; i++){
+    if(pthread_create(&workers[i], NULL, churn_worker, NULL) != 0) perror("Could not create thread");
+  }
+  for(int r=1; r <= REBUILDS; r++){
+    if(r % 3 == 0) stack_init_array(&stacks[r], 4, true); // Alternate the storage modes
+    else if(r % 3 == 1) stack_init_combining(&stacks[r]);
+    else stack_init(&stacks[r]);
+    __atomic_store_n(&live_stack, &stacks[r], __ATOMIC_RELEASE);
+    stack_destroy(&stacks[r - 1]); // Threads may still be inside it
+    ASSERT_EQ(-1, stack_pop(&stacks[r - 1]));
+  }
+  __atomic_store_n(&stop_churn, 1, __ATOMIC_RELEASE);
+  for(int i=0; i < FC_THREADS; i++){
+    void *bad;
+    if(pthread_join(workers[i], &bad) != 0) perror("Could not exit thread");
+    ASSERT_EQ(NULL, bad);
+  }
+
+  // Clean up
+  stack_destroy(&stacks[REBUILDS]);
+}
+
+#define MANY_THREADS (EPOCH_THREADS + 44)
+
+typedef struct many_args {
+  my_stack_t *s;
+  pthread_barrier_t *barrier;
+  int val;
+  int popped;
+} many_args_t;
+
+// Worker thread for tests: push, wait until every worker is alive at once, then pop
+void* many_worker(void* arg){
+  many_args_t *args = (many_args_t*) arg;
+  stack_push(args->s, args->val);
+  pthread_barrier_wait(args->barrier);
+  args->popped = stack_pop(args->s);
+  pthread_exit(0);
+}
+
+// More threads than there are epoch records can use a stack at once
+TEST(StackTest, ManyThreads) {
+  my_stack_t s;
+  stack_init(&s);
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, MANY_THREADS);
+  static many_args_t args[MANY_THREADS];
+  pthread_t workers[MANY_THREADS];
+  for(int i=0; i < MANY_THREADS; i++){
+    args[i].s = &s;
+    args[i].barrier = &barrier;
+    args[i].val = i;
+    if(pthread_create(&workers[i], NULL, many_worker, &args[i]) != 0) perror("Could not create thread");
+  }
+  static bool seen[MANY_THREADS];
+  for(int i=0; i < MANY_THREADS; i++){
+    if(pthread_join(workers[i], NULL) != 0) perror("Could not exit thread");
+    ASSERT_TRUE(args[i].popped >= 0 && args[i].popped < MANY_THREADS);
+    ASSERT_FALSE(seen[args[i].popped]); // Invariant 1: each value popped once
+    seen[args[i].popped] = true;
+  }
+  ASSERT_EQ(-1, stack_pop(&s));
+
+  // Clean up
+  pthread_barrier_destroy(&barrier);
+  stack_destroy(&s);
+}
+
+// Round for the linearizability test: a random mix of pushes and pops, some of them tries
+void lincheck_stack_round(my_history_t* history, void* target, int thread, int first, int ops){
+  my_stack_t *stack = (my_stack_t*) target;
+  for(int i=0; i < ops; i++){
+    unsigned int choice = history_random(history, thread) % 8;
+    lincheck_op_t *op = history_invoke(history, thread, choice < 4 ? LINCHECK_PUT : LINCHECK_TAKE, 0, choice < 4 ? first + i : 0);
+    int result = -1;
+    bool ok = true;
+    if(choice < 3) stack_push(stack, first + i);
+    else if(choice == 3) ok = stack_try_push(stack, first + i);
+    else if(choice < 7) result = stack_pop(stack);
+    else ok = stack_try_pop(stack, &result);
+    history_respond(history, op, ok ? result : -1, ok);
+  }
+}
+
+// Drain for the linearizability test: pop until the stack is empty
+void lincheck_stack_drain(my_history_t* history, void* target, int thread, int first, int ops){
+  my_stack_t *stack = (my_stack_t*) target;
+  int result;
+  do {
+    lincheck_op_t *op = history_invoke(history, thread, LINCHECK_TAKE, 0, 0);
+    result = stack_pop(stack);
+    history_respond(history, op, result, true);
+  } while(result != -1);
+}
+
+// A test of invariant 4 in every mode, with operations delayed at random
+TEST(StackTest, Linearizable) {
+  lincheck_state_t empty;
+  empty.length = 0;
+  my_stack_t s;
+  for(int mode=0; mode < 3; mode++){
+    if(mode == 0) stack_init(&s);
+    else if(mode == 1) stack_init_combining(&s);
+    else stack_init_array(&s, 4, true); // Small, so every round grows and shrinks it
+    ASSERT_EQ(0, lincheck_run(&s, lincheck_stack_round, lincheck_stack_drain, lincheck_stack_step, &empty,
+                              LINCHECK_THREADS, LINCHECK_OPS, LINCHECK_ROUNDS, LINCHECK_PERTURB, mode + 1));
+    stack_destroy(&s);
+  }
+}
@@ -2,55 +2,302 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "epoch.hh"
+
+#define PUSH 0
+#define POP 1
+
+// A stack stores its elements either in a linked list of nodes (the default) or, when
+// initialized with stack_init_array, in a growable array. Every operation below does its
+// storage-specific work through stack_push_locked and stack_pop_locked.
+// Every operation runs inside an epoch critical section, so stack_destroy can close the stack
+// and wait for operations already running to finish before freeing anything; operations that
+// arrive after that see an empty stack.
 
 // Initialize a stack
 void stack_init(my_stack_t* stack) {
-  if(pthread_mutex_init(&stack->lock, NULL) != 0) perror("Could not initialize mutex lock");
+  lock_init(&stack->lock);
   stack->head = NULL;
+  stack->fc = NULL;
+  stack->items = NULL;
+  stack->count = 0;
+  stack->capacity = 0;
+  stack->min_capacity = 0;
+  stack->shrink = false;
+  stack->closed = 0;
+}
+
+// Initialize a stack backed by an array of capacity elements that doubles when full.
+// If shrink is true the array is halved whenever it drops below a quarter full.
+void stack_init_array(my_stack_t* stack, int capacity, bool shrink) {
+  stack_init(stack);
+  if(capacity < 1) capacity = 1;
+  stack->items = (int*) malloc(sizeof(int) * capacity);
+  assert(stack->items != NULL); // A NULL array would leave the stack half list-backed
+  stack->capacity = capacity;
+  stack->min_capacity = capacity;
+  stack->shrink = shrink;
+}
+
+// Initialize a stack in flat-combining mode
+void stack_init_combining(my_stack_t* stack) {
+  stack_init(stack);
+  stack->fc = fc_create();
 }
 
 // Destroy a stack
 void stack_destroy(my_stack_t* stack) {
-  pthread_mutex_lock(&stack->lock);
+  epoch_close(&stack->closed);
+  lock_acquire(&stack->lock);
   node_t *temp = stack->head;
   for(node_t *current = stack->head; current != NULL;){ // free all nodes sequentially
     temp = current;
     current = temp->next;
     free(temp);
   }
+  free(stack->items);
+  stack->items = NULL;
+  if(stack->fc != NULL) fc_destroy(stack->fc);
+}
+
+// Check whether a stack is array-backed. items moves when the array is resized, but
+// min_capacity is fixed at init, so this is safe to call without the lock.
+static bool stack_is_array(my_stack_t* stack){
+  return stack->min_capacity != 0;
+}
+
+// Allocate a node for element. Done outside the lock to keep the critical section short.
+// Array-backed stacks need no node, so this returns NULL for them.
+static node_t* stack_node(my_stack_t* stack, int element){
+  if(stack_is_array(stack)) return NULL;
+  node_t *node = (node_t*)malloc(sizeof(node_t));
+  if(node == NULL) perror("Could not allocate space");
+  node->data = element;
+  return node;
+}
+
+// Resize the array of an array-backed stack. The caller must hold the lock.
+// Returns false, leaving the array as it was, if it could not be resized.
+static bool stack_resize(my_stack_t* stack, int capacity){
+  int *items = (int*) realloc(stack->items, sizeof(int) * (size_t) capacity);
+  if(items == NULL){
+    perror("Could not allocate space");
+    return false;
+  }
+  stack->items = items;
+  stack->capacity = capacity;
+  return true;
+}
+
+// Make room for n more elements. The caller must hold the lock.
+// Returns false if there is no room and the array could not grow.
+static bool stack_reserve(my_stack_t* stack, int n){
+  size_t needed = (size_t) stack->count + n;
+  if(needed <= (size_t) stack->capacity) return true;
+  if(needed > INT_MAX){
+    fprintf(stderr, "Stack cannot hold more than %d elements\n", INT_MAX);
+    return false;
+  }
+  size_t capacity = stack->capacity;
+  while(capacity < needed) capacity *= 2; // Doubling keeps pushes amortized O(1)
+  if(capacity > INT_MAX) capacity = INT_MAX;
+  return stack_resize(stack, (int) capacity);
+}
+
+// Give back memory once the array is mostly empty. The caller must hold the lock.
+static void stack_trim(my_stack_t* stack){
+  if(!stack->shrink) return;
+  int capacity = stack->capacity;
+  while(capacity / 2 >= stack->min_capacity && stack->count < capacity / 4) capacity /= 2;
+  if(capacity != stack->capacity) stack_resize(stack, capacity);
+}
+
+// Push an element (and its node, for list-backed stacks). The caller must hold the lock.
+// Returns false if an array-backed stack is full and could not grow.
+static bool stack_push_locked(my_stack_t* stack, node_t* node, int element){
+  if(stack->items != NULL){
+    if(!stack_reserve(stack, 1)) return false;
+    stack->items[stack->count++] = element;
+  } else {
+    node->next = stack->head; // Set previous node to next
+    SCHED_POINT();
+    stack->head = node;
+  }
+  return true;
 }
 
-// Push an element onto a stack
+// Pop the top element into *element. The caller must hold the lock. Returns false if the stack
+// is empty. For list-backed stacks *node receives the unlinked node, to be freed by the caller.
+static bool stack_pop_locked(my_stack_t* stack, int* element, node_t** node){
+  *node = NULL;
+  if(stack->items != NULL){
+    if(stack->count == 0) return false;
+    *element = stack->items[--stack->count];
+    stack_trim(stack);
+    return true;
+  }
+  node_t *temp = stack->head; // Save head before unlinking it
+  if(temp == NULL) return false;
+  SCHED_POINT();
+  stack->head = temp->next; // Set head to next val
+  *element = temp->data;
+  *node = temp;
+  return true;
+}
+
+// Apply a published push or pop on behalf of another thread (flat-combining mode)
+static void stack_apply(void* structure, fc_slot_t* slot){
+  my_stack_t *stack = (my_stack_t*) structure;
+  if(slot->op == PUSH){
+    node_t *node = (node_t*) slot->node;
+    stack_push_locked(stack, node, node->data);
+  } else {
+    node_t *node;
+    if(!stack_pop_locked(stack, &slot->result, &node)) slot->result = -1;
+    slot->node = node;
+  }
+}
+
+// Push an element onto a stack. An array-backed stack that cannot grow drops the element.
 void stack_push(my_stack_t* stack, int element) {
-  pthread_mutex_lock(&stack->lock);
-  node_t *temp = stack->head; // Previous node saved to temp
-  stack->head = (node_t*)malloc(sizeof(node_t));
-  if(stack->head == NULL) perror("Could not allocate space");
-  stack->head->data = element;
-  stack->head->next = temp; // Set previous node to next
-  pthread_mutex_unlock(&stack->lock);
+  if(!epoch_enter_open(&stack->closed)) return;
+  node_t *node = stack_node(stack, element);
+  if(stack->fc != NULL){
+    fc_slot_t done;
+    fc_execute(stack->fc, &stack->lock, stack, stack_apply, PUSH, node, &done);
+  } else {
+    lock_acquire(&stack->lock);
+    stack_push_locked(stack, node, element);
+    lock_release(&stack->lock);
+  }
+  epoch_exit();
+}
+
+// Push an element onto a stack unless another thread holds the lock (or an array-backed
+// stack cannot grow). Returns true if the element was pushed.
+bool stack_try_push(my_stack_t* stack, int element) {
+  if(!epoch_enter_open(&stack->closed)) return false;
+  node_t *node = stack_node(stack, element);
+  bool pushed = lock_try_acquire(&stack->lock);
+  if(pushed){
+    pushed = stack_push_locked(stack, node, element);
+    lock_release(&stack->lock);
+  } else {
+    free(node);
+  }
+  epoch_exit();
+  return pushed;
+}
+
+// Push n elements onto a stack in one critical section, elements[0] first.
+// Array-backed stacks copy the whole run with a single memcpy, or push none of it if the
+// array cannot grow to hold it.
+void stack_push_many(my_stack_t* stack, const int* elements, int n) {
+  if(n <= 0 || !epoch_enter_open(&stack->closed)) return;
+  if(stack_is_array(stack)){
+    lock_acquire(&stack->lock);
+    if(stack_reserve(stack, n)){
+      memcpy(stack->items + stack->count, elements, sizeof(int) * n);
+      stack->count += n;
+    }
+    lock_release(&stack->lock);
+    epoch_exit();
+    return;
+  }
+  // Build the chain outside the lock, then splice it on top
+  node_t *top = NULL, *bottom = NULL;
+  for(int i=0; i < n; i++){
+    node_t *node = stack_node(stack, elements[i]);
+    node->next = top;
+    top = node;
+    if(bottom == NULL) bottom = node;
+  }
+  lock_acquire(&stack->lock);
+  bottom->next = stack->head;
+  stack->head = top;
+  lock_release(&stack->lock);
+  epoch_exit();
 }
 
 // Check if a stack is empty
 bool stack_empty(my_stack_t* stack) {
-  if(stack->head == NULL){
-    return true;
-  }
-  return false;
+  if(!epoch_enter_open(&stack->closed)) return true;
+  bool empty;
+  if(stack_is_array(stack)) empty = __atomic_load_n(&stack->count, __ATOMIC_RELAXED) == 0;
+  else empty = __atomic_load_n(&stack->head, __ATOMIC_RELAXED) == NULL;
+  epoch_exit();
+  return empty;
 }
 
 // Pop an element off of a stack
 int stack_pop(my_stack_t* stack) {
-  pthread_mutex_lock(&stack->lock);
-  if(stack->head == NULL){
-    pthread_mutex_unlock(&stack->lock);
-    return -1;
-  } else{
-    int val = stack->head->data;
-    node_t *temp = stack->head->next; // Save next and head val before freeing
-    free(stack->head);
-    stack->head = temp; // Set head to next val
-    pthread_mutex_unlock(&stack->lock);
-    return val;
+  if(!epoch_enter_open(&stack->closed)) return -1;
+  int val;
+  node_t *temp;
+  if(stack->fc != NULL){
+    fc_slot_t done;
+    fc_execute(stack->fc, &stack->lock, stack, stack_apply, POP, NULL, &done);
+    val = done.result;
+    temp = (node_t*) done.node;
+  } else {
+    lock_acquire(&stack->lock);
+    if(!stack_pop_locked(stack, &val, &temp)) val = -1;
+    lock_release(&stack->lock);
+  }
+  free(temp); // Free outside the lock
+  epoch_exit();
+  return val;
+}
+
+// Pop an element off of a stack unless another thread holds the lock.
+// Returns true and stores the element if one was popped, false if the stack is busy or empty.
+bool stack_try_pop(my_stack_t* stack, int* element) {
+  if(!epoch_enter_open(&stack->closed)) return false;
+  bool popped = false;
+  if(lock_try_acquire(&stack->lock)){
+    node_t *node;
+    popped = stack_pop_locked(stack, element, &node);
+    lock_release(&stack->lock);
+    free(node);
+  }
+  epoch_exit();
+  return popped;
+}
+
+// Pop up to n elements off of a stack in one critical section. elements receives them in the
+// order they were pushed, so the old top ends up last. Returns the number of elements popped.
+// Array-backed stacks copy the whole run with a single memcpy.
+int stack_pop_many(my_stack_t* stack, int* elements, int n) {
+  if(n <= 0 || !epoch_enter_open(&stack->closed)) return 0;
+  lock_acquire(&stack->lock);
+  if(stack->items != NULL){
+    if(n > stack->count) n = stack->count;
+    stack->count -= n;
+    memcpy(elements, stack->items + stack->count, sizeof(int) * n);
+    stack_trim(stack);
+    lock_release(&stack->lock);
+    epoch_exit();
+    return n;
+  }
+  // Detach up to n nodes, then read and free them outside the lock
+  node_t *top = stack->head, *bottom = NULL;
+  int popped = 0;
+  for(node_t *current = top; current != NULL && popped < n; current = current->next){
+    bottom = current;
+    popped++;
+  }
+  stack->head = bottom != NULL ? bottom->next : stack->head;
+  lock_release(&stack->lock);
+  for(int i = popped - 1; i >= 0; i--){
+    node_t *next = top->next;
+    elements[i] = top->data;
+    free(top);
+    top = next;
   }
+  epoch_exit();
+  return popped;
 }
@@ -4,6 +4,9 @@
 #include <stdbool.h>
 #include <pthread.h>
 
+#include "lock.hh"
+#include "combine.hh"
+
 typedef struct node{
   int data;
   struct node* next;
@@ -11,16 +14,33 @@ typedef struct node{
 
 typedef struct my_stack {
   node_t* head;
-  pthread_mutex_t lock; // Single lock for head of struck
+  my_lock_t lock; // Single lock for head of struck
+  fc_t *fc; // Publication slots in flat-combining mode, NULL otherwise
+  int *items; // Element array for array-backed stacks, NULL for list-backed ones
+  int count, capacity, min_capacity; // Array fill, size, and size it never shrinks below
+  bool shrink; // Halve the array once it drops below a quarter full
+  int closed; // Set by stack_destroy; later operations see an empty stack
 } my_stack_t;
 
 // Initialize a stack
 void stack_init(my_stack_t* stack);
 
-// Destroy a stack
+// Initialize a stack in flat-combining mode: push and pop are published and applied in
+// batches by whichever thread holds the lock
+void stack_init_combining(my_stack_t* stack);
+
+// Initialize a stack backed by an array of capacity elements that doubles when full.
+// If shrink is true the array is halved whenever it drops below a quarter full.
+void stack_init_array(my_stack_t* stack, int capacity, bool shrink);
+
+// Destroy a stack. Operations already running on other threads finish first; later ones act
+// as on an empty stack, so a stack can be replaced online by publishing a new one and then
+// destroying the old one. The my_stack_t itself must stay allocated while threads may use it.
 void stack_destroy(my_stack_t* stack);
 
-// Push an element onto a stack
+// Push an element onto a stack. An array-backed stack that cannot grow (out of memory, or
+// already INT_MAX elements) drops the element with an error message; callers that need to
+// know use stack_try_push, which returns false instead.
 void stack_push(my_stack_t* stack, int element);
 
 // Check if a stack is empty
@@ -29,4 +49,22 @@ bool stack_empty(my_stack_t* stack);
 // Pop an element off of a stack
 int stack_pop(my_stack_t* stack);
 
+// Push an element onto a stack unless another thread holds the lock (or an array-backed
+// stack cannot grow). Returns true if the element was pushed.
+bool stack_try_push(my_stack_t* stack, int element);
+
+// Pop an element off of a stack unless another thread holds the lock.
+// Returns true and stores the element if one was popped, false if the stack is busy or empty.
+bool stack_try_pop(my_stack_t* stack, int* element);
+
+// Push n elements onto a stack in one critical section, elements[0] first.
+// Array-backed stacks copy the whole run with a single memcpy, or push none of it if the
+// array cannot grow to hold it.
+void stack_push_many(my_stack_t* stack, const int* elements, int n);
+
+// Pop up to n elements off of a stack in one critical section. elements receives them in the
+// order they were pushed, so the old top ends up last. Returns the number of elements popped.
+// Array-backed stacks copy the whole run with a single memcpy.
+int stack_pop_many(my_stack_t* stack, int* elements, int n);
+
 #endif